@@ -0,0 +1,419 @@
+/*
+ * Deterministic generator of closed caption sources for benchmarks: a UTF-16LE file with a byte
+ * order mark in the layout of the game's closecaption_*.txt. The same options and seed always
+ * give the same bytes. Keys are unique and their hashes never collide, so every file compiles.
+ *
+ * Usage: gen_corpus [options] out.txt, -h lists the options
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <math.h>
+#include "caption_compile.h"
+
+#define MAX_VALUE_SIZE ((BLOCK_SIZE >> 1) - 1)
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define KEY_CAPACITY 256
+#define LONG_VALUE_ODDS 500
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+typedef struct _CorpusOptions {
+    uint64_t entries;
+    uint64_t seed;
+    uint32_t prefix_share;
+    uint32_t mean_value;
+    uint32_t max_value;
+    uint32_t non_ascii;
+    uint32_t comments;
+    uint8_t crlf;
+} CorpusOptions;
+
+// UTF-16 written out in large pieces, always little endian
+typedef struct _Output {
+    FILE* file;
+    UChar* data;
+    uint64_t size;
+    uint64_t written;
+} Output;
+
+// Hashes handed out so far, open addressing with 0 for an empty slot
+typedef struct _HashSet {
+    uint32_t* slots;
+    uint64_t mask;
+} HashSet;
+
+static const UChar* const shared_prefixes[] = {
+    u"npc_citizen.", u"vo.episode_two.alyx.", u"hl2.chapter_07.scene_", u"music.ambient.city17.",
+    u"combine.soldier.radio.", u"ep2_outland_11.vort_", u"npc_barney.", u"gman.intro.",
+};
+
+static const UChar* const ascii_words[] = {
+    u"Hello", u"plain", u"words", u"here", u"Look", u"out!", u"the", u"Combine", u"citizen", u"Gordon",
+    u"Freeman", u"we", u"have", u"to", u"go", u"now,", u"Doctor.", u"<clr:255,0,0>", u"<sfx>", u"[Grunts]",
+    u"<I>", u"<B>", u"<len:2.5>", u"<norepeat:10>", u"Alyx", u"Kleiner", u"lambda", u"...",
+};
+
+static const UChar* const other_words[] = {
+    u"Ünïcödé", u"日本語のテキスト", u"Привет", u"😀", u"Ελληνικά", u"العربية", u"한국어", u"ñandú",
+    u"Größe", u"façade", u"中文字幕", u"Ça", u"żółw", u"🎵", u"Tschüß",
+};
+
+static const UChar* const comments[] = {
+    u"// Combine radio chatter", u"// TODO: retranslate", u"// Scene cues", u"//",
+};
+
+// xorshift64*, seeded through splitmix64 so any seed, 0 too, gives a good state
+static uint64_t next_random(uint64_t* state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static uint64_t seed_random(uint64_t seed)
+{
+    seed += 0x9E3779B97F4A7C15ULL;
+    seed = (seed ^ (seed >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    seed = (seed ^ (seed >> 27)) * 0x94D049BB133111EBULL;
+    seed ^= seed >> 31;
+
+    return seed ? seed : 1;
+}
+
+static uint32_t random_below(uint64_t* state, const uint64_t n)
+{
+    return next_random(state) % n;
+}
+
+static int8_t chance(uint64_t* state, const uint32_t percent)
+{
+    return random_below(state, 100) < percent;
+}
+
+static int8_t flush_output(Output* out)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for(uint64_t i = 0; i < out->size; ++i)
+        out->data[i] = __builtin_bswap16(out->data[i]);
+#endif
+
+    const int8_t flushed = fwrite(out->data, sizeof(UChar), out->size, out->file) == out->size;
+    out->written += out->size * sizeof(UChar);
+    out->size = 0;
+
+    return flushed;
+}
+
+static int8_t write_units(Output* out, const UChar* data, const uint64_t length)
+{
+    if(out->size + length > OUTPUT_BUFFER_SIZE && !flush_output(out))
+        return 0;
+
+    memcpy(out->data + out->size, data, length * sizeof(UChar));
+    out->size += length;
+
+    return 1;
+}
+
+static int8_t write_line(Output* out, const UChar* data, const uint64_t length, const uint8_t crlf)
+{
+    return write_units(out, data, length) && write_units(out, u"\r\n" + !crlf, 2 - !crlf);
+}
+
+static int8_t write_text(Output* out, const UChar* text, const uint8_t crlf)
+{
+    return write_line(out, text, u_strlen(text), crlf);
+}
+
+static uint32_t append(UChar* data, uint32_t size, const UChar* text)
+{
+    const uint32_t length = u_strlen(text);
+    memcpy(data + size, text, length * sizeof(UChar));
+
+    return size + length;
+}
+
+static uint32_t append_letters(UChar* data, uint32_t size, uint64_t* state, const uint32_t count)
+{
+    for(uint32_t i = 0; i < count; ++i)
+        data[size++] = 'a' + random_below(state, 26);
+
+    return size;
+}
+
+// Base 36, never containing the '_' and '-' that separate it from the rest of the key
+static uint32_t append_number(UChar* data, uint32_t size, uint64_t n)
+{
+    UChar digits[16];
+    uint32_t count = 0;
+    do
+    {
+        const uint32_t digit = n % 36;
+        digits[count++] = (digit < 10) ? '0' + digit : 'a' + digit - 10;
+        n /= 36;
+    } while(n);
+
+    while(count)
+        data[size++] = digits[--count];
+
+    return size;
+}
+
+// A prefix, then "_" and the entry index, unique in every key since nothing after the last '_' repeats.
+// A retry after a hash collision adds "-" and its count. Letters get random case, which hashing undoes.
+static uint32_t make_key(UChar* key, uint64_t* state, const CorpusOptions* options, const uint64_t index, const uint32_t retry)
+{
+    uint32_t size = 0;
+    if(chance(state, options->prefix_share))
+    {
+        size = append(key, size, shared_prefixes[random_below(state, ARRAY_SIZE(shared_prefixes))]);
+        size = append_letters(key, size, state, 2 + random_below(state, 7));
+    }
+    else
+    {
+        size = append_letters(key, size, state, 3 + random_below(state, 8));
+        key[size++] = '.';
+        size = append_letters(key, size, state, 2 + random_below(state, 9));
+    }
+
+    key[size++] = '_';
+    size = append_number(key, size, index);
+    if(retry)
+    {
+        key[size++] = '-';
+        size = append_number(key, size, retry);
+    }
+
+    for(uint32_t i = 0; i < size; ++i)
+    {
+        if(key[i] >= 'a' && key[i] <= 'z' && random_below(state, 5) == 0)
+            key[i] -= 'a' - 'A';
+    }
+
+    return size;
+}
+
+static uint32_t value_length(uint64_t* state, const CorpusOptions* options)
+{
+    // Mostly short lines, exponentially distributed, with the odd paragraph near the limit
+    if(random_below(state, LONG_VALUE_ODDS) == 0)
+        return options->max_value / 2 + random_below(state, options->max_value - options->max_value / 2) + 1;
+
+    const double uniform = (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+    const uint64_t length = 1 + (uint64_t)(-log(1.0 - uniform) * options->mean_value);
+
+    return (length < options->max_value) ? length : options->max_value;
+}
+
+// Words until the next one doesn't fit, then a word of letters up to exactly the chosen length
+static uint32_t make_value(UChar* value, uint64_t* state, const CorpusOptions* options)
+{
+    const uint32_t length = value_length(state, options);
+    uint32_t size = 0;
+
+    while(size < length)
+    {
+        const UChar* word = chance(state, options->non_ascii) ? other_words[random_below(state, ARRAY_SIZE(other_words))]
+                                                              : ascii_words[random_below(state, ARRAY_SIZE(ascii_words))];
+        const uint32_t word_length = u_strlen(word);
+        if(size + word_length + (size > 0) > length)
+            break;
+
+        if(size > 0)
+            value[size++] = ' ';
+        size = append(value, size, word);
+    }
+
+    if(size > 0 && size + 1 < length)
+        value[size++] = ' ';
+
+    return append_letters(value, size, state, length - size);
+}
+
+static int8_t add_hash(HashSet* set, const uint32_t hash)
+{
+    if(hash == 0)
+        return 0;
+
+    uint64_t slot = hash & set->mask;
+    while(set->slots[slot])
+    {
+        if(set->slots[slot] == hash)
+            return 0;
+        slot = (slot + 1) & set->mask;
+    }
+    set->slots[slot] = hash;
+
+    return 1;
+}
+
+static void print_usage(FILE* file, const char* name)
+{
+    fprintf(file, "Usage: %s [options] out.txt\n\
+  -n, --entries N       captions to write (default 10000)\n\
+  -s, --seed N          seed of the random generator (default 1)\n\
+  -p, --prefix-share P  percent of keys starting with one of a few long shared prefixes (default 50)\n\
+  -m, --mean-value N    mean value length in UTF-16 code units (default 80)\n\
+  -M, --max-value N     longest value, at most 4095 (default 4095)\n\
+  -u, --non-ascii P     percent of value words that aren't ASCII (default 10)\n\
+  -c, --comments P      percent of lines that are comments (default 5)\n\
+  -r, --crlf            end lines with CRLF instead of LF\n", name);
+}
+
+static int8_t parse_number(const char* text, const uint64_t max, uint64_t* number)
+{
+    char* end = NULL;
+    errno = 0;
+    const unsigned long long value = strtoull(text, &end, 10);
+    if(errno || *text == '\0' || *end != '\0' || value > max)
+        return 0;
+
+    *number = value;
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    static const struct option long_options[] = {
+        {"entries", required_argument, NULL, 'n'},
+        {"seed", required_argument, NULL, 's'},
+        {"prefix-share", required_argument, NULL, 'p'},
+        {"mean-value", required_argument, NULL, 'm'},
+        {"max-value", required_argument, NULL, 'M'},
+        {"non-ascii", required_argument, NULL, 'u'},
+        {"comments", required_argument, NULL, 'c'},
+        {"crlf", no_argument, NULL, 'r'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0},
+    };
+
+    CorpusOptions options = {10000, 1, 50, 80, MAX_VALUE_SIZE, 10, 5, 0};
+    int option;
+    while((option = getopt_long(argc, argv, "n:s:p:m:M:u:c:rh", long_options, NULL)) != -1)
+    {
+        uint64_t number = 0;
+        int8_t valid = 1;
+        switch(option)
+        {
+            case 'n':
+                valid = parse_number(optarg, UINT32_MAX, &options.entries);
+                break;
+            case 's':
+                valid = parse_number(optarg, UINT64_MAX, &options.seed);
+                break;
+            case 'p':
+            case 'u':
+            case 'c':
+                valid = parse_number(optarg, 100, &number);
+                *((option == 'p') ? &options.prefix_share : (option == 'u') ? &options.non_ascii : &options.comments) = number;
+                break;
+            case 'm':
+            case 'M':
+                valid = parse_number(optarg, MAX_VALUE_SIZE, &number) && number > 0;
+                *((option == 'm') ? &options.mean_value : &options.max_value) = number;
+                break;
+            case 'r':
+                options.crlf = 1;
+                break;
+            case 'h':
+                print_usage(stdout, argv[0]);
+                return 0;
+            default:
+                print_usage(stderr, argv[0]);
+                return 1;
+        }
+
+        if(!valid)
+        {
+            fprintf(stderr, "Invalid value '%s' for option -%c\n", optarg, option);
+            return 1;
+        }
+    }
+
+    if(optind + 1 != argc)
+    {
+        print_usage(stderr, argv[0]);
+        return 1;
+    }
+
+    // At most half full
+    uint64_t slot_count = 1024;
+    while(slot_count < options.entries * 2)
+        slot_count <<= 1;
+
+    HashSet hashes = {(uint32_t*)calloc(slot_count, sizeof(uint32_t)), slot_count - 1};
+    Output out = {fopen(argv[optind], "wb"), (UChar*)malloc(OUTPUT_BUFFER_SIZE * sizeof(UChar)), 0, 0};
+    if(!hashes.slots || !out.data || !out.file)
+    {
+        fprintf(stderr, "Could not write '%s': %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    uint64_t state = seed_random(options.seed);
+    uint64_t line_count = 0, retry_count = 0;
+    const uint8_t crlf = options.crlf;
+
+    static const UChar byte_order_mark[] = {0xFEFF};
+    int8_t written = write_units(&out, byte_order_mark, 1) && write_text(&out, u"\"lang\"", crlf) && write_text(&out, u"{", crlf) &&
+                     write_text(&out, u"\t\"Language\" \"English\"", crlf) && write_text(&out, u"\t\"Tokens\"", crlf) && write_text(&out, u"\t{", crlf);
+    line_count += 5;
+
+    UChar line[KEY_CAPACITY + MAX_VALUE_SIZE + 8];
+    for(uint64_t i = 0; i < options.entries && written; ++i)
+    {
+        if(chance(&state, options.comments))
+        {
+            written = write_text(&out, comments[random_below(&state, ARRAY_SIZE(comments))], crlf);
+            ++line_count;
+        }
+
+        // The hash is taken from a copy, caption_hash lowercases in place
+        UChar key[KEY_CAPACITY], lowered[KEY_CAPACITY];
+        uint32_t key_size = 0;
+        for(uint32_t retry = 0; ; ++retry)
+        {
+            key_size = make_key(key, &state, &options, i, retry);
+            memcpy(lowered, key, key_size * sizeof(UChar));
+
+            Caption caption = {0};
+            caption.key = lowered;
+            caption.key_size = key_size;
+            if(caption_hash(&caption) && add_hash(&hashes, caption.hash))
+                break;
+            ++retry_count;
+        }
+
+        uint32_t size = 0;
+        line[size++] = '\t';
+        line[size++] = '\"';
+        memcpy(line + size, key, key_size * sizeof(UChar));
+        size += key_size;
+        size = append(line, size, u"\"\t\"");
+        size += make_value(line + size, &state, &options);
+        line[size++] = '\"';
+
+        written = written && write_line(&out, line, size, crlf);
+        ++line_count;
+    }
+
+    written = written && write_text(&out, u"\t}", crlf) && write_text(&out, u"}", crlf) && flush_output(&out);
+    line_count += 2;
+
+    if(fclose(out.file) != 0 || !written)
+    {
+        fprintf(stderr, "Could not write '%s': %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    fprintf(stdout, "%s: %lu entries, %lu lines, %lu bytes, %lu keys regenerated after a hash collision\n", argv[optind], options.entries, line_count, out.written, retry_count);
+
+    free(hashes.slots);
+    free(out.data);
+
+    return 0;
+}
\ No newline at end of file
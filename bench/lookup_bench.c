@@ -0,0 +1,129 @@
+/*
+ * Lookup microbenchmark for caption_reader: every entry once with an empty block cache
+ * and the file dropped from the page cache, then random lookups with everything warm.
+ *
+ * Usage: lookup_bench file.dat [cache blocks] [warm lookups]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include "caption_reader.h"
+
+#define DEFAULT_CACHE_BLOCKS 64
+#define DEFAULT_LOOKUPS 1000000
+#define VALUE_CAPACITY 4096
+
+static double now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+// xorshift64*, fixed seed so runs can be compared
+static uint64_t next_random(uint64_t* state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+// Looks up hashes in order and returns the nanoseconds per lookup; checksum keeps the values in use
+static double run_lookups(CaptionReader* reader, const uint32_t* hashes, const uint64_t count, uint64_t* checksum)
+{
+    UChar value[VALUE_CAPACITY];
+
+    const double start = now_ns();
+    for(uint64_t i = 0; i < count; ++i)
+    {
+        const int32_t length = caption_reader_find_hash(reader, hashes[i], value, VALUE_CAPACITY);
+        if(length < 0)
+        {
+            fprintf(stderr, "Lookup of hash %u failed: %s\n", hashes[i], strerror(errno));
+            exit(1);
+        }
+        *checksum += length + value[0];
+    }
+
+    return count ? (now_ns() - start) / count : 0;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        fprintf(stderr, "Usage: %s file.dat [cache blocks] [warm lookups]\n", argv[0]);
+        return 1;
+    }
+
+    const uint32_t cache_blocks = (argc > 2) ? strtoul(argv[2], NULL, 10) : DEFAULT_CACHE_BLOCKS;
+    const uint64_t warm_count = (argc > 3) ? strtoull(argv[3], NULL, 10) : DEFAULT_LOOKUPS;
+
+    // Best effort, so the first pass has to go to the disk
+    const int fd = open(argv[1], O_RDONLY);
+    if(fd >= 0)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+
+    const double open_start = now_ns();
+    CaptionReader* reader = caption_reader_open(argv[1], cache_blocks);
+    if(!reader)
+    {
+        fprintf(stderr, "Could not open '%s': %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    const double open_time = now_ns() - open_start;
+
+    const uint64_t entry_count = reader->header.dir_size;
+    // Zeroed, so the lists are never read uninitialized even when they're empty
+    uint32_t* cold = (uint32_t*)calloc(entry_count ? entry_count : 1, sizeof(uint32_t));
+    uint32_t* warm = (uint32_t*)calloc(warm_count ? warm_count : 1, sizeof(uint32_t));
+    if(!cold || !warm)
+    {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    // Every entry once in a shuffled order, then uniformly random ones
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for(uint64_t i = 0; i < entry_count; ++i)
+        cold[i] = reader->entries[i].hash;
+    for(uint64_t i = entry_count; i > 1; --i)
+    {
+        const uint64_t j = next_random(&state) % i;
+        const uint32_t temp = cold[i - 1];
+        cold[i - 1] = cold[j];
+        cold[j] = temp;
+    }
+    for(uint64_t i = 0; i < warm_count && entry_count; ++i)
+        warm[i] = reader->entries[next_random(&state) % entry_count].hash;
+
+    uint64_t checksum = 0;
+    const double cold_ns = run_lookups(reader, cold, entry_count, &checksum);
+    const uint64_t cold_hits = reader->hits, cold_misses = reader->misses;
+
+    const double warm_ns = run_lookups(reader, warm, entry_count ? warm_count : 0, &checksum);
+    const uint64_t warm_hits = reader->hits - cold_hits, warm_misses = reader->misses - cold_misses;
+
+    fprintf(stdout, "%s: %lu entries in %d blocks, cache of %u blocks (%u KB)\n", argv[1], entry_count, reader->header.block_count, reader->slot_count, reader->slot_count * (uint32_t)reader->header.block_size / 1024);
+    fprintf(stdout, "open: %.2f ms to read the directory and sort it by hash\n", open_time / 1e6);
+    fprintf(stdout, "cold: %lu lookups, %.0f ns each, %.1f%% block cache hits\n", entry_count, cold_ns, cold_hits + cold_misses ? 100.0 * cold_hits / (cold_hits + cold_misses) : 0.0);
+    fprintf(stdout, "warm: %lu lookups, %.0f ns each, %.1f%% block cache hits\n", entry_count ? warm_count : 0, warm_ns, warm_hits + warm_misses ? 100.0 * warm_hits / (warm_hits + warm_misses) : 0.0);
+    fprintf(stdout, "checksum: %lu\n", checksum);
+
+    caption_reader_destroy(&reader);
+    free(cold);
+    free(warm);
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#!/bin/sh
+#
+# End to end compile benchmark. Generates closed caption sources with gen_corpus for every size and
+# profile below, compiles each with --stats=json for every thread count and keeps the fastest of
+# BENCH_RUNS runs. Corpora are deterministic and generated once, so reruns on the same machine compare.
+#
+# Settings, from the environment:
+#   BENCH_SIZES    entry counts (default "1000 10000 100000 1000000", up to 5000000 works)
+#   BENCH_PROFILES profiles from the list below (default all of them)
+#   BENCH_THREADS  thread counts passed to -j (default "1" and the number of processors)
+#   BENCH_RUNS     runs per combination, the fastest is kept (default 3)
+#   BENCH_WORK     where corpora and .dat files go (default $TMPDIR/captioncompiler-bench)
+#   BENCH_RESULTS  JSON lines appended per combination (default $BENCH_WORK/results.jsonl)
+
+set -e
+
+BENCH_DIR=$(cd "$(dirname "$0")" && pwd)
+COMPILER="$BENCH_DIR/../captioncompiler"
+GENERATOR="$BENCH_DIR/gen_corpus"
+
+SIZES=${BENCH_SIZES:-"1000 10000 100000 1000000"}
+PROFILES=${BENCH_PROFILES:-"default ascii shared unicode long noisy"}
+PROCESSORS=$(nproc 2>/dev/null || echo 1)
+if [ "$PROCESSORS" -gt 1 ]; then THREADS=${BENCH_THREADS:-"1 $PROCESSORS"}; else THREADS=${BENCH_THREADS:-1}; fi
+RUNS=${BENCH_RUNS:-3}
+WORK=${BENCH_WORK:-${TMPDIR:-/tmp}/captioncompiler-bench}
+RESULTS=${BENCH_RESULTS:-$WORK/results.jsonl}
+
+# gen_corpus options of every profile
+profile_options()
+{
+    case "$1" in
+        default) echo "" ;;
+        ascii)   echo "--prefix-share 0 --non-ascii 0 --comments 0" ;;
+        shared)  echo "--prefix-share 100" ;;
+        unicode) echo "--non-ascii 60" ;;
+        long)    echo "--mean-value 1000" ;;
+        noisy)   echo "--comments 30 --crlf" ;;
+        *)       echo "Unknown profile '$1'" >&2; exit 1 ;;
+    esac
+}
+
+# Number after "name": in a line of JSON
+json_value()
+{
+    printf '%s\n' "$1" | sed -n "s/.*\"$2\":\([0-9.]*\).*/\1/p"
+}
+
+for tool in "$COMPILER" "$GENERATOR"; do
+    if [ ! -x "$tool" ]; then
+        echo "$tool is missing, build it with make bench" >&2
+        exit 1
+    fi
+done
+
+mkdir -p "$WORK"
+
+COMMIT=$(git -C "$BENCH_DIR" rev-parse --short HEAD 2>/dev/null || echo unknown)
+MACHINE="$(uname -srm), $PROCESSORS processors, $(sed -n 's/^model name[^:]*: //p' /proc/cpuinfo 2>/dev/null | head -n 1)"
+DATE=$(date -u +%Y-%m-%dT%H:%M:%SZ)
+
+echo "captioncompiler $COMMIT on $MACHINE"
+echo "Best of $RUNS runs, results appended to $RESULTS"
+echo
+printf '%-8s %8s %3s %9s %12s %9s %8s %8s %8s %8s %8s %10s\n' profile entries j MB/s captions/s total_ms parse hash sort fill write peak_kb
+
+for size in $SIZES; do
+    for profile in $PROFILES; do
+        options=$(profile_options "$profile")
+        source="$WORK/closecaption_${profile}_${size}.txt"
+        if [ ! -f "$source" ]; then
+            # shellcheck disable=SC2086
+            "$GENERATOR" --entries "$size" $options "$source" > /dev/null
+        fi
+
+        for threads in $THREADS; do
+            best=""
+            best_ms=""
+            run=0
+            while [ "$run" -lt "$RUNS" ]; do
+                stats=$("$COMPILER" -j "$threads" --stats=json "$source")
+                total_ms=$(json_value "$stats" total_ms)
+                if [ -z "$best" ] || [ "$(echo "$total_ms < $best_ms" | awk '{ print ($1 < $3) }')" = 1 ]; then
+                    best=$stats
+                    best_ms=$total_ms
+                fi
+                run=$((run + 1))
+            done
+
+            printf '{"date":"%s","commit":"%s","machine":"%s","profile":"%s","entries":%s,"threads":%s,"runs":%s,%s\n' \
+                "$DATE" "$COMMIT" "$MACHINE" "$profile" "$size" "$threads" "$RUNS" "${best#\{}" >> "$RESULTS"
+
+            printf '%-8s %8s %3s %9s %12s %9s %8s %8s %8s %8s %8s %10s\n' "$profile" "$size" "$threads" \
+                "$(json_value "$best" mb_per_s)" "$(json_value "$best" captions_per_s)" "$best_ms" \
+                "$(json_value "$best" parse)" "$(json_value "$best" hash)" "$(json_value "$best" sort)" \
+                "$(json_value "$best" fill)" "$(json_value "$best" write)" "$(json_value "$best" peak_rss_kb)"
+        done
+    done
+done
\ No newline at end of file
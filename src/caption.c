@@ -1,54 +1,96 @@
-#include <stdlib.h>
 #include <errno.h>
+#include <unicode/uchar.h>
 #include "caption.h"
 #include "valve_crc32.h"
 
-Caption* caption_init()
-{
-    Caption* caption = (Caption*)malloc(sizeof(Caption));
-    if(__builtin_expect(caption != NULL, 0))
-    {
-        caption->hash = 0;
-        caption->key = NULL;
-        caption->value = NULL;
-    }
-
-    return caption;
-}
+#define HASH_BUFFER_SIZE 256
 
+// Lowercases the key in place, encodes it to UTF-8 and feeds the CRC in a single pass.
+// Lowercasing is per code unit like u_tolower on a UChar, so surrogates are left alone.
 Caption* caption_hash(Caption* caption)
 {
-    int32_t buff_capacity = (caption->key->size + 1) * UTF8_MAX_CHAR_LENGTH;
-    int32_t buff_size = 0;
-    char* buffer = (char*)malloc(buff_capacity);
-    if(!buffer)
-        return NULL;
-
-    UErrorCode error_code = 0;
-    u_strToUTF8(buffer, buff_capacity, &buff_size, caption->key->data, caption->key->size, &error_code);
-    
-    if(!U_FAILURE(error_code))
-        caption->hash = CRC32_ProcessSingleBuffer(buffer, buff_size);
-    else
+    register UChar* data = (UChar*)caption->key;
+    const UChar* const end = data + caption->key_size;
+
+    unsigned char buffer[HASH_BUFFER_SIZE];
+    register uint32_t size = 0;
+
+    CRC32_t crc;
+    CRC32_Init(&crc);
+
+    while(data < end)
     {
-        errno = EIO;
-        caption = NULL;
+        // Keep room for the longest sequence
+        if(size > HASH_BUFFER_SIZE - U8_MAX_LENGTH)
+        {
+            CRC32_ProcessBuffer(&crc, buffer, size);
+            size = 0;
+        }
+
+        UChar ch = *data;
+        if(ch < 0x80)
+        {
+            if(ch >= 'A' && ch <= 'Z')
+                *data = ch += 'a' - 'A';
+
+            buffer[size++] = (unsigned char)ch;
+            ++data;
+            continue;
+        }
+
+        if(!U16_IS_SURROGATE(ch))
+        {
+            const UChar lower = (UChar)u_tolower(ch);
+            if(lower != ch)
+                *data = ch = lower;
+        }
+        ++data;
+
+        if(ch < 0x80)
+            buffer[size++] = (unsigned char)ch;
+        else if(ch < 0x800)
+        {
+            buffer[size++] = 0xC0 | (ch >> 6);
+            buffer[size++] = 0x80 | (ch & 0x3F);
+        }
+        else if(!U16_IS_SURROGATE(ch))
+        {
+            buffer[size++] = 0xE0 | (ch >> 12);
+            buffer[size++] = 0x80 | ((ch >> 6) & 0x3F);
+            buffer[size++] = 0x80 | (ch & 0x3F);
+        }
+        else if(U16_IS_LEAD(ch) && data < end && U16_IS_TRAIL(*data))
+        {
+            const UChar32 code_point = U16_GET_SUPPLEMENTARY(ch, *data);
+            ++data;
+
+            buffer[size++] = 0xF0 | (code_point >> 18);
+            buffer[size++] = 0x80 | ((code_point >> 12) & 0x3F);
+            buffer[size++] = 0x80 | ((code_point >> 6) & 0x3F);
+            buffer[size++] = 0x80 | (code_point & 0x3F);
+        }
+        else
+        {
+            // Unpaired surrogate, which u_strToUTF8 rejected as well
+            errno = EIO;
+            return NULL;
+        }
     }
 
-    free(buffer);
+    CRC32_ProcessBuffer(&crc, buffer, size);
+    CRC32_Final(&crc);
+    caption->hash = crc;
 
     return caption;
 }
 
-void caption_destroy(Caption** caption)
+int32_t caption_compare(const Caption* self, const Caption* caption)
 {
-    Caption* temp_caption = *caption;
-    if(temp_caption->key)
-        ustring_destroy(&temp_caption->key);
+    const uint32_t min_length = (self->key_size < caption->key_size) ? self->key_size : caption->key_size;
 
-    if(temp_caption->value)
-        ustring_destroy(&temp_caption->value);
+    int32_t result = u_memcmp(self->key, caption->key, min_length);
+    if(result == 0)
+        result = (int32_t)self->key_size - (int32_t)caption->key_size;
 
-    free(temp_caption);
-    *caption = NULL;
+    return result;
 }
\ No newline at end of file
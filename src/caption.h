@@ -3,15 +3,22 @@
 
 #include "ustring.h"
 
+// Key and value point into the loaded source file, block and offset are filled in by compile.
+// key_id is only used by batch compiles, see caption_intern.h
 typedef struct _Caption {
-    UString* key;
-    UString* value;
+    const UChar* key;
+    const UChar* value;
+    uint32_t key_size;
     uint32_t hash;
+    uint32_t line;
+    uint32_t key_id;
+    int32_t block;
+    int16_t offset;
+    uint16_t value_size;
 } Caption;
 
-Caption* caption_init();
 Caption* caption_hash(Caption* caption);
 
-void caption_destroy(Caption** caption);
+int32_t caption_compare(const Caption* self, const Caption* caption);
 
 #endif
\ No newline at end of file
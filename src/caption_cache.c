@@ -0,0 +1,298 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <memory.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "caption_cache.h"
+#include "caption_intern.h"
+#include "fingerprint.h"
+
+#define CACHE_EMPTY UINT32_MAX
+#define CACHE_MISS UINT32_MAX
+
+static int8_t read_all(const int fd, void* data, uint64_t size)
+{
+    char* p = (char*)data;
+    while(size)
+    {
+        const ssize_t n = read(fd, p, size);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return 0;
+
+        p += n;
+        size -= n;
+    }
+
+    return 1;
+}
+
+static int8_t write_all(const int fd, const void* data, uint64_t size)
+{
+    const char* p = (const char*)data;
+    while(size)
+    {
+        const ssize_t n = write(fd, p, size);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return 0;
+
+        p += n;
+        size -= n;
+    }
+
+    return 1;
+}
+
+static CacheEntry* make_entries(const CaptionTable* table)
+{
+    CacheEntry* entries = (CacheEntry*)malloc((table->size ? table->size : 1) * sizeof(CacheEntry));
+    if(!entries)
+        return NULL;
+
+    for(uint64_t i = 0; i < table->size; ++i)
+    {
+        const Caption* caption = &table->data[i];
+        entries[i] = (CacheEntry){caption->hash, 0, fingerprint64(caption->key, caption->key_size * sizeof(UChar))};
+    }
+
+    return entries;
+}
+
+// Hashes are unique within a build, collisions are rejected before anything gets cached
+static CaptionCache* index_entries(CaptionCache* cache)
+{
+    uint64_t capacity = 16;
+    while(capacity < (uint64_t)cache->header.entry_count << 1)
+        capacity <<= 1;
+
+    cache->mask = capacity - 1;
+    cache->slots = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    if(!cache->slots)
+        return NULL;
+
+    memset(cache->slots, 0xFF, capacity * sizeof(uint32_t));
+    for(uint32_t i = 0; i < cache->header.entry_count; ++i)
+    {
+        register uint64_t slot = cache->entries[i].hash & cache->mask;
+        while(cache->slots[slot] != CACHE_EMPTY)
+            slot = (slot + 1) & cache->mask;
+        cache->slots[slot] = i;
+    }
+
+    return cache;
+}
+
+static uint32_t lookup(const CaptionCache* self, const uint32_t hash)
+{
+    register uint64_t slot = hash & self->mask;
+    while(self->slots[slot] != CACHE_EMPTY)
+    {
+        if(self->entries[self->slots[slot]].hash == hash)
+            return self->slots[slot];
+        slot = (slot + 1) & self->mask;
+    }
+
+    return CACHE_MISS;
+}
+
+CaptionCache* caption_cache_load(const char* path)
+{
+    CaptionCache* cache = (CaptionCache*)calloc(1, sizeof(CaptionCache));
+    if(!cache)
+        return NULL;
+
+    const int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        goto caption_cache_load_error;
+
+    struct stat st;
+    if(!read_all(fd, &cache->header, sizeof(CacheHeader)) || fstat(fd, &st) != 0)
+        goto caption_cache_load_error;
+
+    const CacheHeader* header = &cache->header;
+    if(header->magic != CACHE_MAGIC || header->version != CACHE_VERSION
+       || (uint64_t)st.st_size != sizeof(CacheHeader) + (uint64_t)header->entry_count * sizeof(CacheEntry))
+    {
+        errno = EINVAL;
+        goto caption_cache_load_error;
+    }
+
+    cache->entries = (CacheEntry*)malloc((header->entry_count ? header->entry_count : 1) * sizeof(CacheEntry));
+    if(!cache->entries || !read_all(fd, cache->entries, header->entry_count * sizeof(CacheEntry)) || !index_entries(cache))
+        goto caption_cache_load_error;
+
+    close(fd);
+
+    return cache;
+
+    caption_cache_load_error:
+    {
+        const int error = errno;
+        if(fd >= 0)
+            close(fd);
+        caption_cache_destroy(&cache);
+        errno = error;
+    }
+
+    return NULL;
+}
+
+int8_t caption_cache_fresh(const CaptionCache* self, const uint32_t options, const uint64_t source_size, const uint64_t source_fingerprint, const char* out_path)
+{
+    struct stat st;
+    if(!self || stat(out_path, &st) != 0)
+        return 0;
+
+    const CacheHeader* header = &self->header;
+    return header->options == options
+        && header->source_size == source_size && header->source_fingerprint == source_fingerprint
+        && header->output_size == (uint64_t)st.st_size
+        && header->output_seconds == st.st_mtim.tv_sec && header->output_nanoseconds == st.st_mtim.tv_nsec;
+}
+
+CaptionTable* caption_cache_sort(const CaptionCache* self, CaptionTable* table, ThreadPool* pool)
+{
+    if(!self || !self->header.entry_count)
+        return caption_table_sort(table, pool);
+
+    const uint64_t n = table->size;
+    CaptionTable* fresh = caption_table_init(0);
+    Caption* scratch = (Caption*)malloc((n ? n : 1) * sizeof(Caption));
+    if(!fresh || !scratch)
+    {
+        if(fresh)
+            caption_table_destroy(&fresh);
+        free(scratch);
+        return NULL;
+    }
+
+    // A key is known if its hash is cached and the lowercased key behind it still is the same
+    uint64_t known_count = 0;
+    for(uint64_t i = 0; i < n; ++i)
+    {
+        Caption caption = table->data[i];
+        const uint32_t rank = lookup(self, caption.hash);
+        if(rank != CACHE_MISS && self->entries[rank].key_fingerprint == fingerprint64(caption.key, caption.key_size * sizeof(UChar)))
+        {
+            caption.key_id = rank;
+            table->data[known_count++] = caption;
+        }
+        else if(!caption_table_push(fresh, &caption))
+            goto caption_cache_sort_error;
+    }
+
+    // Known keys by cached rank, then merge the new ones in
+    table->size = known_count;
+    if(!caption_intern_sort(table) || !caption_table_sort(fresh, pool))
+        goto caption_cache_sort_error;
+
+    uint64_t i = 0, j = 0, k = 0;
+    while(i < known_count && j < fresh->size)
+        scratch[k++] = (caption_compare(&table->data[i], &fresh->data[j]) < 0) ? table->data[i++] : fresh->data[j++];
+    while(i < known_count)
+        scratch[k++] = table->data[i++];
+    while(j < fresh->size)
+        scratch[k++] = fresh->data[j++];
+
+    free(table->data);
+    table->data = scratch;
+    table->size = n;
+    table->capacity = n ? n : 1;
+
+    caption_table_destroy(&fresh);
+
+    return table;
+
+    caption_cache_sort_error:
+    {
+        const int error = errno;
+        table->size = n;
+        caption_table_destroy(&fresh);
+        free(scratch);
+        errno = error;
+    }
+
+    return NULL;
+}
+
+int8_t caption_cache_save(const char* path, const uint32_t options, const uint64_t source_size, const uint64_t source_fingerprint, const char* out_path, const CaptionTable* table)
+{
+    struct stat st;
+    if(stat(out_path, &st) != 0)
+        return 0;
+
+    // Hidden and unique next to the cache, so builds sharing a directory never write into each other's
+    const char* name = strrchr(path, '/');
+    const uint32_t dir_length = name ? name + 1 - path : 0;
+    char temp_path[strlen(path) + 9];
+    memcpy(temp_path, path, dir_length);
+    sprintf(temp_path + dir_length, ".%s.XXXXXX", path + dir_length);
+
+    CacheEntry* entries = make_entries(table);
+    if(!entries)
+        return 0;
+
+    const CacheHeader header = {
+        CACHE_MAGIC, CACHE_VERSION,
+        options,
+        table->size,
+        source_size, source_fingerprint,
+        st.st_size,
+        st.st_mtim.tv_sec, st.st_mtim.tv_nsec,
+    };
+
+    int8_t saved = 0;
+    const int fd = mkstemp(temp_path);
+    if(fd >= 0)
+    {
+        // mkstemp creates it readable by the owner only
+        saved = fchmod(fd, 0644) == 0 &&
+                write_all(fd, &header, sizeof(CacheHeader)) && write_all(fd, entries, table->size * sizeof(CacheEntry));
+        saved = (close(fd) == 0) && saved;
+
+        if(!saved || rename(temp_path, path) != 0)
+        {
+            const int error = errno;
+            unlink(temp_path);
+            errno = error;
+            saved = 0;
+        }
+    }
+
+    free(entries);
+
+    return saved;
+}
+
+CaptionCache* caption_cache_init(const CaptionTable* table)
+{
+    CaptionCache* cache = (CaptionCache*)calloc(1, sizeof(CaptionCache));
+    if(!cache)
+        return NULL;
+
+    cache->header.magic = CACHE_MAGIC;
+    cache->header.version = CACHE_VERSION;
+    cache->header.entry_count = table->size;
+
+    cache->entries = make_entries(table);
+    if(!cache->entries || !index_entries(cache))
+        caption_cache_destroy(&cache);
+
+    return cache;
+}
+
+void caption_cache_destroy(CaptionCache** self)
+{
+    if(!*self)
+        return;
+
+    free((*self)->entries);
+    free((*self)->slots);
+    free(*self);
+    *self = NULL;
+}
\ No newline at end of file
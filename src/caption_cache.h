@@ -0,0 +1,53 @@
+#ifndef CAPTION_CACHE_H_INCLUDED
+#define CAPTION_CACHE_H_INCLUDED
+
+#include "caption_table.h"
+#include "thread_pool.h"
+
+#define CACHE_MAGIC 0x43414343 // "CCAC"
+#define CACHE_VERSION 1
+
+// What a .dat was built from. The source is identified by content, the output by size and modification time.
+typedef struct _CacheHeader {
+    uint32_t magic, version;
+    uint32_t options;
+    uint32_t entry_count;
+    uint64_t source_size, source_fingerprint;
+    uint64_t output_size;
+    int64_t output_seconds, output_nanoseconds;
+} CacheHeader;
+
+// One key of the last build, stored in sorted order so its index is its rank
+typedef struct _CacheEntry {
+    uint32_t hash;
+    uint32_t reserved;
+    uint64_t key_fingerprint;
+} CacheEntry;
+
+// State of the previous build of one .dat, saved next to it
+typedef struct _CaptionCache {
+    CacheHeader header;
+    CacheEntry* entries;
+    uint32_t* slots;
+    uint64_t mask;
+} CaptionCache;
+
+// Returns NULL with errno set if there is no usable cache at path
+CaptionCache* caption_cache_load(const char* path);
+
+// Whether the output at out_path is still what the same source and options would produce
+int8_t caption_cache_fresh(const CaptionCache* self, const uint32_t options, const uint64_t source_size, const uint64_t source_fingerprint, const char* out_path);
+
+// Sorts a deduplicated table like caption_table_sort. Keys found in the cache keep their cached order,
+// only new ones are sorted and merged in. self may be NULL.
+CaptionTable* caption_cache_sort(const CaptionCache* self, CaptionTable* table, ThreadPool* pool);
+
+// Records a finished build of out_path from the sorted table; written to a temporary file first and renamed over path
+int8_t caption_cache_save(const char* path, const uint32_t options, const uint64_t source_size, const uint64_t source_fingerprint, const char* out_path, const CaptionTable* table);
+
+// In-memory cache of a sorted table, only good for caption_cache_sort
+CaptionCache* caption_cache_init(const CaptionTable* table);
+
+void caption_cache_destroy(CaptionCache** self);
+
+#endif
\ No newline at end of file
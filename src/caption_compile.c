@@ -0,0 +1,629 @@
+#include <stdlib.h>
+#include <memory.h>
+#include <errno.h>
+#include "caption_compile.h"
+#include "caption_intern.h"
+#include "caption_layout.h"
+#include "ustring_scan.h"
+
+#define MIN_CHUNK_SIZE 65536
+#define FILL_TASKS_PER_THREAD 4
+#define HASH_TASKS_PER_THREAD 4
+
+typedef struct _ParseChunk {
+    SourceFile source;
+    CaptionTable* table;
+    uint32_t line_count;
+    int error;
+    uint8_t flags;
+} ParseChunk;
+
+// A range of the table whose keys get hashed by one task
+typedef struct _HashTask {
+    Caption* captions;
+    uint64_t first, last;
+    uint32_t line;
+    int error;
+} HashTask;
+
+// A range of the table whose directory entries and values get written by one task
+typedef struct _FillTask {
+    const Caption* captions;
+    const uint32_t* shared;
+    char* directory;
+    char* blocks;
+    uint64_t first, last;
+    uint8_t flags;
+} FillTask;
+
+static void set_status(CompileStatus* status, const int error, const uint32_t line)
+{
+    status->system_error = error;
+    status->line = line;
+
+    switch(error)
+    {
+        case 0:
+            status->code = CompileOk;
+            break;
+        case ENOMEM:
+            status->code = CompileNoMemory;
+            break;
+        case ENODATA:
+            status->code = CompileNoTokens;
+            break;
+        case EINVAL:
+            status->code = CompileEmptyKey;
+            break;
+        case EOVERFLOW:
+            status->code = CompileValueTooLong;
+            break;
+        case EEXIST:
+        {
+            const Caption* first = &status->conflict.first;
+            const Caption* second = &status->conflict.second;
+            const int8_t same_key = first->key_size == second->key_size && u_memcmp(first->key, second->key, first->key_size) == 0;
+            status->code = same_key ? CompileDuplicateKey : CompileHashCollision;
+            break;
+        }
+        case EIO:
+        case EILSEQ:
+            status->code = CompileInvalidText;
+            break;
+        default:
+            status->code = CompileSystemError;
+            break;
+    }
+}
+
+const char* caption_compile_error_string(const CompileError code)
+{
+    switch(code)
+    {
+        case CompileOk:
+            return "Success";
+        case CompileNoMemory:
+            return "Out of memory";
+        case CompileNoTokens:
+            return "Could not find token declaration";
+        case CompileEmptyKey:
+            return "Key of length 0";
+        case CompileValueTooLong:
+            return "Value exceeds maximum length";
+        case CompileDuplicateKey:
+            return "Key is already defined";
+        case CompileHashCollision:
+            return "Two keys have the same hash";
+        case CompileInvalidText:
+            return "Text is not valid Unicode";
+        case CompileOutputTooSmall:
+            return "Output buffer is too small";
+        case CompileSystemError:
+            return "System error";
+    }
+
+    return "Unknown error";
+}
+
+// Whether the key starts with "[english]" once lowercased
+static int8_t is_english_key(const Caption* caption)
+{
+    static const UChar english[] = u"[english]";
+    if(caption->key_size < 9)
+        return 0;
+
+    for(uint32_t i = 0; i < 9; ++i)
+    {
+        if(u_tolower(caption->key[i]) != english[i])
+            return 0;
+    }
+
+    return 1;
+}
+
+static Caption* extract_strings(Caption* caption, const UStringView* line, int8_t* error)
+{
+    register const UChar* data = ustring_skip_space(line->data, line->data + line->size);
+    const UChar* const end = line->data + line->size;
+
+    if(data == end || *data == '/' || *data == '{' || *data == '}')
+        return NULL;
+
+    if(*data == '\"')
+        ++data;
+
+    // Key, lowercased later by caption_hash
+    caption->key = data;
+    data = ustring_find_key_end(data, end);
+    caption->key_size = data - caption->key;
+
+    if(data < end && *data == '\"')
+        ++data;
+
+    if(caption->key_size == 0)
+    {
+        *error = 1;
+        errno = EINVAL;
+        return NULL;
+    }
+    else if(is_english_key(caption))
+        return NULL;
+
+    // Value
+    data = ustring_skip_space(data, end);
+
+    if(data < end && *data == '\"')
+        ++data;
+
+    const uint32_t value_size = ustring_find_quote(data, end) - data;
+    caption->value = data;
+    caption->value_size = value_size;
+
+    if(value_size == 0)
+        caption = NULL;
+    else if(value_size + 1 > (BLOCK_SIZE >> 1))
+    {
+        *error = 1;
+        errno = EOVERFLOW;
+        caption = NULL;
+    }
+
+    return caption;
+}
+
+static Caption* parse_caption(Caption* caption, const UStringView* line, int8_t* error)
+{
+    *error = 0;
+
+    if(!extract_strings(caption, line, error))
+        return NULL;
+
+    if(!caption_hash(caption))
+    {
+        *error = 1;
+        return NULL;
+    }
+
+    return caption;
+}
+
+static void parse_chunk(void* data)
+{
+    ParseChunk* chunk = (ParseChunk*)data;
+    UStringView line;
+    int8_t error = 0;
+
+    while(!source_file_eof(&chunk->source))
+    {
+        ++chunk->line_count;
+        source_file_getline(&chunk->source, &line);
+
+        if(chunk->flags & CompileVerbose)
+            u_fprintf(u_get_stdout(), "Parsing line \'%.*S\'\n", line.size, line.data);
+        
+        // Batch compiles hash every distinct key once after all languages are read
+        Caption caption;
+        Caption* parsed = (chunk->flags & CompileSharedKeys) ? extract_strings(&caption, &line, &error) : parse_caption(&caption, &line, &error);
+        if(__builtin_expect(parsed != NULL, 0))
+        {    
+            caption.line = chunk->line_count;
+            if(!caption_table_push(chunk->table, &caption))
+            {
+                chunk->error = errno;
+                return;
+            }
+        }
+        else if(error)
+        {
+            chunk->error = errno;
+            return;
+        }
+    }
+}
+
+CaptionTable* caption_compile_parse(SourceFile* source, ThreadPool* pool, const uint8_t flags, CompileStatus* status)
+{
+    CaptionTable* table = NULL;
+    ParseChunk* chunks = NULL;
+    uint32_t chunk_count = 0;
+    uint32_t line_count = 0;
+    UStringView line;
+
+    table = caption_table_init(0);
+    if(!table)
+        goto caption_parse_error;
+
+    while(!source_file_eof(source))
+    {
+        ++line_count;
+        source_file_getline(source, &line);
+
+        const UChar* const end = line.data + line.size;
+        register const UChar* data = ustring_skip_space(line.data, end);
+
+        if(data < end && *data == '\"')
+            ++data;
+
+        if(end - data >= 6 && u_memcmp(data, u"Tokens", 6) == 0)
+            break;
+    }
+
+    if(source_file_eof(source))
+    {
+        errno = ENODATA;
+        goto caption_parse_error;
+    }
+
+    // Split the body into line aligned chunks, one per thread unless it's too small to be worth it.
+    // Verbose output has to stay in order, so it gets a single chunk.
+    const uint64_t body_start = source->position;
+    const uint64_t body_size = source->size - body_start;
+    const uint64_t max_chunks = body_size / MIN_CHUNK_SIZE + 1;
+    const uint32_t wanted_chunks = (flags & CompileVerbose) ? 1 : pool->thread_count + 1;
+    const uint32_t total_chunks = (wanted_chunks < max_chunks) ? wanted_chunks : max_chunks;
+
+    chunks = (ParseChunk*)malloc(total_chunks * sizeof(ParseChunk));
+    if(!chunks)
+        goto caption_parse_error;
+
+    uint64_t position = body_start;
+    for(; chunk_count < total_chunks; ++chunk_count)
+    {
+        uint64_t chunk_end = source->size;
+        if(chunk_count + 1 < total_chunks)
+        {
+            chunk_end = body_start + body_size * (chunk_count + 1) / total_chunks;
+            if(chunk_end < position)
+                chunk_end = position;
+            else
+            {
+                uint8_t needs_fixup = 0;
+                const UChar* const end = source->data + source->size;
+                const UChar* const line_end = ustring_find_line_end(source->data + chunk_end, end, &needs_fixup);
+                chunk_end = (line_end - source->data) + (line_end < end);
+            }
+        }
+
+        ParseChunk* chunk = &chunks[chunk_count];
+        // Roughly one caption per 64 code units
+        chunk->table = caption_table_init((chunk_end - position) >> 6);
+        if(!chunk->table)
+            goto caption_parse_error;
+
+        // Borrowed view of the source limited to this chunk, never destroyed
+        chunk->source = *source;
+        chunk->source.position = position;
+        chunk->source.size = chunk_end;
+        chunk->source.mapped_length = 0;
+
+        chunk->line_count = 0;
+        chunk->error = 0;
+        chunk->flags = flags;
+
+        position = chunk_end;
+    }
+
+    thread_pool_run(pool, parse_chunk, chunks, sizeof(ParseChunk), chunk_count);
+
+    // Merge in file order so the result is the same as a serial parse
+    for(uint32_t i = 0; i < chunk_count; ++i)
+    {
+        const uint32_t first_line = line_count;
+        line_count += chunks[i].line_count;
+        if(chunks[i].error)
+        {
+            errno = chunks[i].error;
+            goto caption_parse_error;
+        }
+
+        // The first chunk's table is taken over as is, later ones are copied onto its end
+        const uint64_t first_caption = table->size;
+        if(i == 0)
+        {
+            CaptionTable* temp = table;
+            table = chunks[i].table;
+            chunks[i].table = temp;
+        }
+        else if(!caption_table_append(table, chunks[i].table))
+            goto caption_parse_error;
+
+        // Chunks count their lines from the start of the chunk
+        for(uint64_t j = first_caption; j < table->size; ++j)
+            table->data[j].line += first_line;
+    }
+
+    if(flags & CompileVerbose)
+        u_fprintf(u_get_stdout(), "Found %lu entries\n\n", table->size);
+
+    set_status(status, 0, line_count);
+    goto caption_parse_end;
+
+    caption_parse_error:
+    {
+        set_status(status, errno, line_count);
+
+        if(table)
+            caption_table_destroy(&table);
+    }
+
+    caption_parse_end:
+    {
+        for(uint32_t i = 0; i < chunk_count; ++i)
+            caption_table_destroy(&chunks[i].table);
+        free(chunks);
+    }
+
+    return table;
+}
+
+static void hash_task(void* data)
+{
+    HashTask* task = (HashTask*)data;
+    for(uint64_t i = task->first; i < task->last; ++i)
+    {
+        if(__builtin_expect(!caption_hash(&task->captions[i]), 0))
+        {
+            task->line = task->captions[i].line;
+            task->error = errno;
+            return;
+        }
+    }
+}
+
+int8_t caption_compile_hash(CaptionTable* table, ThreadPool* pool, CompileStatus* status)
+{
+    const uint32_t task_count = (pool->thread_count + 1) * HASH_TASKS_PER_THREAD;
+    HashTask* tasks = (HashTask*)malloc(task_count * sizeof(HashTask));
+    if(!tasks)
+    {
+        set_status(status, errno, 0);
+        return 0;
+    }
+
+    for(uint32_t i = 0; i < task_count; ++i)
+        tasks[i] = (HashTask){table->data, table->size * i / task_count, table->size * (i + 1) / task_count, 0, 0};
+
+    thread_pool_run(pool, hash_task, tasks, sizeof(HashTask), task_count);
+
+    // Ranges are in table order, so the first failed one has the first bad key
+    set_status(status, 0, 0);
+    for(uint32_t i = 0; i < task_count; ++i)
+    {
+        if(tasks[i].error)
+        {
+            set_status(status, tasks[i].error, tasks[i].line);
+            break;
+        }
+    }
+    free(tasks);
+
+    return status->code == CompileOk;
+}
+
+CaptionTable* caption_compile_finish(CaptionTable* table, ThreadPool* pool, const CaptionCache* cache, const DuplicatePolicy policy, const uint8_t flags, CompileStatus* status)
+{
+    const uint64_t parsed_count = table->size;
+    if(!caption_table_index(table, policy, &status->conflict))
+    {
+        set_status(status, errno, 0);
+        return NULL;
+    }
+
+    if((flags & CompileVerbose) && table->size != parsed_count)
+        u_fprintf(u_get_stdout(), "Removed %lu duplicate entries\n\n", parsed_count - table->size);
+
+    if(!((flags & CompileSharedKeys) ? caption_intern_sort(table) : caption_cache_sort(cache, table, pool)))
+    {
+        set_status(status, errno, 0);
+        return NULL;
+    }
+
+    set_status(status, 0, 0);
+
+    return table;
+}
+
+int8_t caption_compile_layout(CaptionTable* table, const uint8_t flags, CompileLayout* layout, CompileStatus* status)
+{
+    Header* header = &layout->header;
+    header->vccd = VCCD;
+    header->version = VERSION;
+    header->block_count = 0;
+    header->block_size = BLOCK_SIZE;
+    header->dir_size = table->size;
+    header->data_offset = HEADER_SIZE + table->size * DIR_ENTRY_SIZE;
+    header->data_offset += 512 - (header->data_offset % 512);
+
+    // Identical values can share a slot, the directory entries just point at the same place
+    layout->shared = NULL;
+    layout->unique_count = table->size;
+    if(flags & CompileDedup)
+    {
+        layout->shared = caption_layout_dedup(table, &layout->unique_count);
+        if(!layout->shared)
+            goto caption_layout_error;
+    }
+
+    // The directory stays in key order either way, only block and offset differ
+    layout->greedy_block_count = caption_layout_greedy(table, layout->shared, BLOCK_SIZE);
+    header->block_count = layout->greedy_block_count;
+    if(flags & CompilePack)
+    {
+        // First-fit decreasing can need more blocks than table order, keep whichever is smaller
+        header->block_count = caption_layout_pack(table, layout->shared, BLOCK_SIZE);
+        if(header->block_count >= layout->greedy_block_count)
+            header->block_count = caption_layout_greedy(table, layout->shared, BLOCK_SIZE);
+    }
+    if(header->block_count < 0)
+        goto caption_layout_error;
+
+    layout->size = header->data_offset + (uint64_t)header->block_count * BLOCK_SIZE;
+    set_status(status, 0, 0);
+
+    return 1;
+
+    caption_layout_error:
+    {
+        set_status(status, errno, 0);
+        caption_compile_release(layout);
+    }
+
+    return 0;
+}
+
+static void fill_task(void* data)
+{
+    const FillTask* task = (const FillTask*)data;
+
+    register char* entry = task->directory + task->first * DIR_ENTRY_SIZE;
+    for(uint64_t i = task->first; i < task->last; ++i)
+    {
+        const Caption* caption = &task->captions[i];
+        const int16_t length_bytes = (caption->value_size + 1) * sizeof(UChar);
+
+        if(task->flags & CompileVerbose)
+            u_fprintf(u_get_stdout(), "Writing Caption data for \'%.*S\'\nHash: %u\nBlock: %d\nOffset: %hd\nLength: %hd\n\n", caption->value_size, caption->value, caption->hash, caption->block, caption->offset, length_bytes);
+
+        memcpy(entry, &caption->hash, sizeof(uint32_t));
+        memcpy(entry + 4, &caption->block, sizeof(int32_t));
+        memcpy(entry + 8, &caption->offset, sizeof(int16_t));
+        memcpy(entry + 10, &length_bytes, sizeof(int16_t));
+        entry += DIR_ENTRY_SIZE;
+
+        if(task->shared && task->shared[i] != i)
+            continue;
+
+        // Copy straight from the source, the terminating '\0' and the padding are already zero
+        memcpy(task->blocks + (uint64_t)caption->block * BLOCK_SIZE + caption->offset, caption->value, caption->value_size * sizeof(UChar));
+    }
+}
+
+int8_t caption_compile_fill(const CaptionTable* table, const CompileLayout* layout, char* out, ThreadPool* pool, const uint8_t flags, CompileStatus* status)
+{
+    memcpy(out, &layout->header, HEADER_SIZE);
+
+    // Every entry and value has its final position now, so ranges of the table can be written independently.
+    // Verbose output has to stay in order, so it gets a single task.
+    const uint32_t task_count = (flags & CompileVerbose) ? 1 : (pool->thread_count + 1) * FILL_TASKS_PER_THREAD;
+    FillTask* tasks = (FillTask*)malloc(task_count * sizeof(FillTask));
+    if(!tasks)
+    {
+        set_status(status, errno, 0);
+        return 0;
+    }
+
+    for(uint32_t i = 0; i < task_count; ++i)
+        tasks[i] = (FillTask){table->data, layout->shared, out + HEADER_SIZE, out + layout->header.data_offset, table->size * i / task_count, table->size * (i + 1) / task_count, flags};
+
+    thread_pool_run(pool, fill_task, tasks, sizeof(FillTask), task_count);
+    free(tasks);
+    set_status(status, 0, 0);
+
+    return 1;
+}
+
+void caption_compile_release(CompileLayout* layout)
+{
+    free(layout->shared);
+    layout->shared = NULL;
+}
+
+// Compiles text, which is taken over and released
+static CompileError compile_text(UChar* text, const uint64_t length, char* out, const uint64_t out_capacity, uint64_t* out_size, const CompileOptions* options, CompileStatus* status)
+{
+    SourceFile source = {text, length, 0, 0};
+    if(length && text[0] == 0xFEFF)
+        source_file_skip(&source, 1);
+
+    // Without a pool everything runs on the calling thread
+    ThreadPool serial_pool = {0};
+    ThreadPool* pool = options->pool ? options->pool : &serial_pool;
+    const uint8_t flags = options->flags & ~CompileSharedKeys;
+
+    CompileLayout layout = {0};
+    CaptionTable* table = caption_compile_parse(&source, pool, flags, status);
+    if(!table || !caption_compile_finish(table, pool, NULL, options->policy, flags, status) || !caption_compile_layout(table, flags, &layout, status))
+        goto compile_text_end;
+
+    *out_size = layout.size;
+    if(layout.size > out_capacity)
+    {
+        status->code = CompileOutputTooSmall;
+        goto compile_text_end;
+    }
+
+    memset(out, 0, layout.size);
+    caption_compile_fill(table, &layout, out, pool, flags, status);
+
+    compile_text_end:
+    {
+        // The keys of a conflict point into the copy freed below, only their lines and hashes stay
+        status->conflict.first.key = status->conflict.second.key = NULL;
+        status->conflict.first.value = status->conflict.second.value = NULL;
+
+        caption_compile_release(&layout);
+        if(table)
+            caption_table_destroy(&table);
+        free(text);
+    }
+
+    return status->code;
+}
+
+CompileError caption_compile_utf16(const UChar* text, const uint64_t length, char* out, const uint64_t out_capacity, uint64_t* out_size, const CompileOptions* options, CompileStatus* status)
+{
+    memset(status, 0, sizeof(CompileStatus));
+    *out_size = 0;
+
+    // Parsing edits the text in place, so it works on a copy
+    UChar* data = (UChar*)malloc((length ? length : 1) * sizeof(UChar));
+    if(!data)
+    {
+        set_status(status, errno, 0);
+        return status->code;
+    }
+    memcpy(data, text, length * sizeof(UChar));
+
+    return compile_text(data, length, out, out_capacity, out_size, options, status);
+}
+
+CompileError caption_compile_utf8(const char* text, const uint64_t length, char* out, const uint64_t out_capacity, uint64_t* out_size, const CompileOptions* options, CompileStatus* status)
+{
+    UErrorCode error = U_ZERO_ERROR;
+    int32_t utf16_length = 0;
+
+    memset(status, 0, sizeof(CompileStatus));
+    *out_size = 0;
+
+    if(length > INT32_MAX)
+    {
+        set_status(status, EFBIG, 0);
+        return status->code;
+    }
+
+    // Measure first, then convert; ill-formed UTF-8 is rejected rather than replaced
+    u_strFromUTF8(NULL, 0, &utf16_length, text, length, &error);
+    if(error != U_BUFFER_OVERFLOW_ERROR && U_FAILURE(error))
+    {
+        set_status(status, EILSEQ, 0);
+        return status->code;
+    }
+
+    UChar* data = (UChar*)malloc((utf16_length ? utf16_length : 1) * sizeof(UChar));
+    if(!data)
+    {
+        set_status(status, errno, 0);
+        return status->code;
+    }
+
+    error = U_ZERO_ERROR;
+    u_strFromUTF8(data, utf16_length, NULL, text, length, &error);
+    if(U_FAILURE(error))
+    {
+        free(data);
+        set_status(status, EILSEQ, 0);
+        return status->code;
+    }
+
+    return compile_text(data, utf16_length, out, out_capacity, out_size, options, status);
+}
\ No newline at end of file
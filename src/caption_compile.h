@@ -0,0 +1,100 @@
+#ifndef CAPTION_COMPILE_H_INCLUDED
+#define CAPTION_COMPILE_H_INCLUDED
+
+#include "caption_cache.h"
+#include "caption_index.h"
+#include "source_file.h"
+
+#define VCCD 1145258838
+#define VERSION 1
+#define BLOCK_SIZE 8192
+#define DIR_ENTRY_SIZE (4+4+2+2)
+#define HEADER_SIZE 24
+
+typedef struct _Header {
+    int32_t vccd, version;
+    int32_t block_count, block_size;
+    int32_t dir_size;
+    int32_t data_offset;
+} Header;
+
+typedef enum _CompileFlags {
+    CompileVerbose = 0x01,    // Progress on stdout, for the command line tool
+    CompilePack = 0x02,
+    CompileDedup = 0x04,
+    CompileSharedKeys = 0x08, // Batch compiles, keys are hashed and sorted by caption_intern_keys
+} CompileFlags;
+
+typedef enum _CompileError {
+    CompileOk = 0,
+    CompileNoMemory,
+    CompileNoTokens,
+    CompileEmptyKey,
+    CompileValueTooLong,
+    CompileDuplicateKey,
+    CompileHashCollision,
+    CompileInvalidText,
+    CompileOutputTooSmall,
+    CompileSystemError,
+} CompileError;
+
+// What went wrong. line is where a parse error was found, or the number of lines read after a
+// successful parse; conflict holds both definitions of a duplicate key or colliding hash, its keys
+// point into the source and go away with it. caption_compile_utf16 and caption_compile_utf8 parse a
+// copy of their text that is gone when they return, so from them conflict only has lines and hashes.
+typedef struct _CompileStatus {
+    CompileError code;
+    int system_error;
+    uint32_t line;
+    CaptionConflict conflict;
+} CompileStatus;
+
+// Where every value goes, from caption_compile_layout
+typedef struct _CompileLayout {
+    Header header;
+    uint32_t* shared;
+    uint64_t unique_count;
+    int32_t greedy_block_count;
+    uint64_t size;
+} CompileLayout;
+
+typedef struct _CompileOptions {
+    ThreadPool* pool;       // NULL compiles on the calling thread
+    DuplicatePolicy policy;
+    uint8_t flags;
+} CompileOptions;
+
+// Compiles a whole closed caption source held in memory into out, the text optionally starting with
+// a byte order mark. out_size is set to the size of the .dat, also when it doesn't fit out_capacity
+// and CompileOutputTooSmall is returned. Nothing is shared between calls, so any number may run at once.
+// A duplicate key or hash collision is reported by the line and hash of both definitions in
+// status->conflict; the key and value pointers are NULL.
+CompileError caption_compile_utf16(const UChar* text, const uint64_t length, char* out, const uint64_t out_capacity, uint64_t* out_size, const CompileOptions* options, CompileStatus* status);
+CompileError caption_compile_utf8(const char* text, const uint64_t length, char* out, const uint64_t out_capacity, uint64_t* out_size, const CompileOptions* options, CompileStatus* status);
+
+const char* caption_compile_error_string(const CompileError code);
+
+// The steps behind the functions above, for callers that keep their own tables, caches or files.
+// All of them return NULL or 0 with status filled in on failure.
+
+// Parses every caption after the Tokens line, in source order. The source is edited in place and
+// has to outlive the table; parsing starts at its current position.
+CaptionTable* caption_compile_parse(SourceFile* source, ThreadPool* pool, const uint8_t flags, CompileStatus* status);
+
+// Lowercases and hashes every key of a table parsed with CompileSharedKeys, in parallel. Parsing
+// without the flag does the same as it goes; this lets the two be timed apart.
+int8_t caption_compile_hash(CaptionTable* table, ThreadPool* pool, CompileStatus* status);
+
+// Removes duplicates according to policy, then sorts by key, reusing the order in cache if there is one
+CaptionTable* caption_compile_finish(CaptionTable* table, ThreadPool* pool, const CaptionCache* cache, const DuplicatePolicy policy, const uint8_t flags, CompileStatus* status);
+
+// Places every value of the sorted table and works out the size of the .dat. With CompilePack the
+// values are only packed when that takes fewer blocks than filling them in key order
+int8_t caption_compile_layout(CaptionTable* table, const uint8_t flags, CompileLayout* layout, CompileStatus* status);
+
+// Writes the .dat for a laid out table into out, which has to be layout->size zeroed bytes
+int8_t caption_compile_fill(const CaptionTable* table, const CompileLayout* layout, char* out, ThreadPool* pool, const uint8_t flags, CompileStatus* status);
+
+void caption_compile_release(CompileLayout* layout);
+
+#endif
\ No newline at end of file
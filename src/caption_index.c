@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include <memory.h>
+#include <errno.h>
+#include "caption_index.h"
+
+#define INDEX_EMPTY UINT32_MAX
+#define INDEX_MIN_CAPACITY 16
+
+static int8_t keys_equal(const Caption* a, const Caption* b)
+{
+    return a->key_size == b->key_size && u_memcmp(a->key, b->key, a->key_size) == 0;
+}
+
+CaptionTable* caption_table_index(CaptionTable* table, const DuplicatePolicy policy, CaptionConflict* conflict)
+{
+    // Open addressing with linear probing, at most half full
+    uint64_t capacity = INDEX_MIN_CAPACITY;
+    while(capacity < table->size << 1)
+        capacity <<= 1;
+
+    const uint64_t mask = capacity - 1;
+    uint32_t* slots = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    if(!slots)
+        return NULL;
+
+    memset(slots, 0xFF, capacity * sizeof(uint32_t));
+
+    uint64_t removed = 0;
+    for(uint64_t i = 0; i < table->size; ++i)
+    {
+        Caption* caption = &table->data[i];
+
+        // The CRC is already well mixed, its low bits are used as is
+        register uint64_t slot = caption->hash & mask;
+        while(slots[slot] != INDEX_EMPTY && table->data[slots[slot]].hash != caption->hash)
+            slot = (slot + 1) & mask;
+
+        if(__builtin_expect(slots[slot] == INDEX_EMPTY, 1))
+        {
+            slots[slot] = i;
+            continue;
+        }
+
+        Caption* existing = &table->data[slots[slot]];
+        if(policy == DuplicateError || !keys_equal(existing, caption))
+        {
+            conflict->first = *existing;
+            conflict->second = *caption;
+
+            free(slots);
+            errno = EEXIST;
+            return NULL;
+        }
+
+        // Removed captions are marked with a NULL key and compacted away below
+        ++removed;
+        if(policy == DuplicateFirst)
+            caption->key = NULL;
+        else
+        {
+            existing->key = NULL;
+            slots[slot] = i;
+        }
+    }
+
+    free(slots);
+
+    if(removed)
+    {
+        uint64_t size = 0;
+        for(uint64_t i = 0; i < table->size; ++i)
+        {
+            if(table->data[i].key)
+                table->data[size++] = table->data[i];
+        }
+        table->size = size;
+    }
+
+    return table;
+}
\ No newline at end of file
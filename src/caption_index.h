@@ -0,0 +1,22 @@
+#ifndef CAPTION_INDEX_H_INCLUDED
+#define CAPTION_INDEX_H_INCLUDED
+
+#include "caption_table.h"
+
+typedef enum _DuplicatePolicy {
+    DuplicateError = 0,
+    DuplicateFirst,
+    DuplicateLast,
+} DuplicatePolicy;
+
+// Two captions that can't both go into the .dat; keys are equal for a duplicate, different for a CRC collision
+typedef struct _CaptionConflict {
+    Caption first;
+    Caption second;
+} CaptionConflict;
+
+// Indexes the table by hash and removes duplicate keys according to policy, keeping table order.
+// Returns NULL with errno set to EEXIST and conflict filled in if a duplicate isn't allowed or two keys collide.
+CaptionTable* caption_table_index(CaptionTable* table, const DuplicatePolicy policy, CaptionConflict* conflict);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,321 @@
+#include <stdlib.h>
+#include <memory.h>
+#include <errno.h>
+#include "caption_intern.h"
+#include "valve_crc32.h"
+
+#define INTERN_EMPTY UINT64_MAX
+#define INTERN_MIN_CAPACITY 1024
+#define KEY_RANGE_SIZE 4096
+#define RADIX_BITS 16
+
+// Upper bits pick the shard, the lower ones the slot inside it
+#define SHARD_OF(hash, shard_count) ((uint32_t)(((uint64_t)(hash) * (shard_count)) >> 32))
+
+typedef struct _HashTask {
+    CaptionTable* table;
+} HashTask;
+
+// Every distinct raw key whose hash falls into one shard, found by scanning all tables.
+// Slots hold the hash above the key index, so most probes never touch the keys.
+typedef struct _ShardTask {
+    CaptionTable** tables;
+    uint32_t table_count;
+    uint32_t shard, shard_count;
+    CaptionTable* keys;
+    uint64_t* slots;
+    uint64_t capacity;
+    int error;
+} ShardTask;
+
+typedef struct _KeyTask {
+    Caption* keys;
+    uint64_t first, last;
+    int error;
+} KeyTask;
+
+typedef struct _ApplyTask {
+    CaptionTable* table;
+    const Caption* keys;
+    const uint64_t* offsets;
+    const uint32_t* ranks;
+    uint32_t shard_count;
+} ApplyTask;
+
+static void hash_task(void* data)
+{
+    CaptionTable* table = ((HashTask*)data)->table;
+    for(uint64_t i = 0; i < table->size; ++i)
+    {
+        Caption* caption = &table->data[i];
+        caption->hash = CRC32_ProcessSingleBuffer(caption->key, caption->key_size * sizeof(UChar));
+    }
+}
+
+static int8_t grow_shard(ShardTask* task)
+{
+    const uint64_t capacity = task->capacity ? task->capacity << 1 : INTERN_MIN_CAPACITY;
+    uint64_t* slots = (uint64_t*)malloc(capacity * sizeof(uint64_t));
+    if(!slots)
+        return 0;
+
+    memset(slots, 0xFF, capacity * sizeof(uint64_t));
+    for(uint64_t i = 0; i < task->keys->size; ++i)
+    {
+        const uint32_t hash = task->keys->data[i].hash;
+        register uint64_t slot = hash & (capacity - 1);
+        while(slots[slot] != INTERN_EMPTY)
+            slot = (slot + 1) & (capacity - 1);
+        slots[slot] = ((uint64_t)hash << 32) | i;
+    }
+
+    free(task->slots);
+    task->slots = slots;
+    task->capacity = capacity;
+
+    return 1;
+}
+
+static void shard_task(void* data)
+{
+    ShardTask* task = (ShardTask*)data;
+
+    for(uint32_t t = 0; t < task->table_count; ++t)
+    {
+        CaptionTable* table = task->tables[t];
+        for(uint64_t i = 0; i < table->size; ++i)
+        {
+            Caption* caption = &table->data[i];
+            if(SHARD_OF(caption->hash, task->shard_count) != task->shard)
+                continue;
+
+            // At most half full
+            if(__builtin_expect(task->keys->size >= task->capacity >> 1, 0) && !grow_shard(task))
+            {
+                task->error = errno;
+                return;
+            }
+
+            const uint64_t mask = task->capacity - 1;
+            register uint64_t slot = caption->hash & mask;
+            while(task->slots[slot] != INTERN_EMPTY)
+            {
+                if((task->slots[slot] >> 32) == caption->hash)
+                {
+                    const Caption* key = &task->keys->data[(uint32_t)task->slots[slot]];
+                    if(key->key_size == caption->key_size && u_memcmp(key->key, caption->key, key->key_size) == 0)
+                        break;
+                }
+                slot = (slot + 1) & mask;
+            }
+
+            if(task->slots[slot] == INTERN_EMPTY)
+            {
+                task->slots[slot] = ((uint64_t)caption->hash << 32) | task->keys->size;
+                if(!caption_table_push(task->keys, caption))
+                {
+                    task->error = errno;
+                    return;
+                }
+            }
+
+            // Local to the shard until the shards are concatenated
+            caption->key_id = (uint32_t)task->slots[slot];
+        }
+    }
+}
+
+// Lowercases and hashes each distinct key in place, as caption_hash does for a single table
+static void key_task(void* data)
+{
+    KeyTask* task = (KeyTask*)data;
+    for(uint64_t i = task->first; i < task->last; ++i)
+    {
+        if(!caption_hash(&task->keys[i]))
+        {
+            task->error = errno;
+            return;
+        }
+    }
+}
+
+static void apply_task(void* data)
+{
+    const ApplyTask* task = (const ApplyTask*)data;
+    CaptionTable* table = task->table;
+
+    for(uint64_t i = 0; i < table->size; ++i)
+    {
+        Caption* caption = &table->data[i];
+        const uint32_t rank = task->ranks[task->offsets[SHARD_OF(caption->hash, task->shard_count)] + caption->key_id];
+        const Caption* key = &task->keys[rank];
+
+        caption->key = key->key;
+        caption->key_size = key->key_size;
+        caption->hash = key->hash;
+        caption->key_id = rank;
+    }
+}
+
+int64_t caption_intern_keys(CaptionTable** tables, const uint32_t table_count, ThreadPool* pool)
+{
+    const uint32_t shard_count = pool->thread_count + 1;
+    int64_t result = -1;
+
+    HashTask* hash_tasks = (HashTask*)malloc(table_count * sizeof(HashTask));
+    ShardTask* shards = (ShardTask*)calloc(shard_count, sizeof(ShardTask));
+    ApplyTask* apply_tasks = (ApplyTask*)malloc(table_count * sizeof(ApplyTask));
+    uint64_t* offsets = (uint64_t*)calloc(shard_count + 1, sizeof(uint64_t));
+    KeyTask* key_tasks = NULL;
+    uint32_t* ranks = NULL;
+    CaptionTable* keys = NULL;
+    if(!hash_tasks || !shards || !apply_tasks || !offsets)
+        goto caption_intern_end;
+
+    // Hash the raw keys, cheap next to lowercasing and encoding them
+    for(uint32_t i = 0; i < table_count; ++i)
+        hash_tasks[i].table = tables[i];
+    thread_pool_run(pool, hash_task, hash_tasks, sizeof(HashTask), table_count);
+
+    for(uint32_t i = 0; i < shard_count; ++i)
+    {
+        shards[i] = (ShardTask){tables, table_count, i, shard_count, caption_table_init(0), NULL, 0, 0};
+        if(!shards[i].keys)
+            goto caption_intern_end;
+    }
+    thread_pool_run(pool, shard_task, shards, sizeof(ShardTask), shard_count);
+
+    for(uint32_t i = 0; i < shard_count; ++i)
+    {
+        if(shards[i].error)
+        {
+            errno = shards[i].error;
+            goto caption_intern_end;
+        }
+        offsets[i + 1] = offsets[i] + shards[i].keys->size;
+    }
+
+    keys = caption_table_init(offsets[shard_count]);
+    if(!keys)
+        goto caption_intern_end;
+
+    for(uint32_t i = 0; i < shard_count; ++i)
+    {
+        if(!caption_table_append(keys, shards[i].keys))
+            goto caption_intern_end;
+    }
+
+    const uint64_t key_count = keys->size;
+    const uint32_t key_task_count = key_count / KEY_RANGE_SIZE + 1;
+    key_tasks = (KeyTask*)malloc(key_task_count * sizeof(KeyTask));
+    ranks = (uint32_t*)malloc((key_count ? key_count : 1) * sizeof(uint32_t));
+    if(!key_tasks || !ranks)
+        goto caption_intern_end;
+
+    for(uint32_t i = 0; i < key_task_count; ++i)
+        key_tasks[i] = (KeyTask){keys->data, key_count * i / key_task_count, key_count * (i + 1) / key_task_count, 0};
+    thread_pool_run(pool, key_task, key_tasks, sizeof(KeyTask), key_task_count);
+
+    for(uint32_t i = 0; i < key_task_count; ++i)
+    {
+        if(key_tasks[i].error)
+        {
+            errno = key_tasks[i].error;
+            goto caption_intern_end;
+        }
+    }
+
+    // Sort the distinct keys once. Keys only differing in case are equal now and share the rank of the first one.
+    for(uint64_t i = 0; i < key_count; ++i)
+        keys->data[i].key_id = i;
+
+    if(!caption_table_sort(keys, pool))
+        goto caption_intern_end;
+
+    for(uint64_t i = 0; i < key_count; ++i)
+    {
+        const Caption* key = &keys->data[i];
+        ranks[key->key_id] = (i > 0 && caption_compare(key, &keys->data[i - 1]) == 0) ? ranks[keys->data[i - 1].key_id] : i;
+    }
+
+    for(uint32_t i = 0; i < table_count; ++i)
+        apply_tasks[i] = (ApplyTask){tables[i], keys->data, offsets, ranks, shard_count};
+    thread_pool_run(pool, apply_task, apply_tasks, sizeof(ApplyTask), table_count);
+
+    result = key_count;
+
+    caption_intern_end:
+    {
+        const int error = errno;
+
+        if(shards)
+        {
+            for(uint32_t i = 0; i < shard_count; ++i)
+            {
+                if(shards[i].keys)
+                    caption_table_destroy(&shards[i].keys);
+                free(shards[i].slots);
+            }
+        }
+        if(keys)
+            caption_table_destroy(&keys);
+
+        free(hash_tasks);
+        free(shards);
+        free(apply_tasks);
+        free(offsets);
+        free(key_tasks);
+        free(ranks);
+
+        errno = error;
+    }
+
+    return result;
+}
+
+// LSD radix sort on the rank, stable, so it can't reorder anything caption_table_sort wouldn't
+CaptionTable* caption_intern_sort(CaptionTable* table)
+{
+    const uint64_t n = table->size;
+    if(n < 2)
+        return table;
+
+    Caption* scratch = (Caption*)malloc(n * sizeof(Caption));
+    uint64_t* counts = (uint64_t*)malloc((1 << RADIX_BITS) * sizeof(uint64_t));
+    if(!scratch || !counts)
+    {
+        free(scratch);
+        free(counts);
+        return NULL;
+    }
+
+    Caption* from = table->data;
+    Caption* to = scratch;
+    for(uint32_t shift = 0; shift < 32; shift += RADIX_BITS)
+    {
+        memset(counts, 0, (1 << RADIX_BITS) * sizeof(uint64_t));
+        for(uint64_t i = 0; i < n; ++i)
+            ++counts[(from[i].key_id >> shift) & ((1 << RADIX_BITS) - 1)];
+
+        uint64_t sum = 0;
+        for(uint32_t i = 0; i < (1 << RADIX_BITS); ++i)
+        {
+            const uint64_t count = counts[i];
+            counts[i] = sum;
+            sum += count;
+        }
+
+        for(uint64_t i = 0; i < n; ++i)
+            to[counts[(from[i].key_id >> shift) & ((1 << RADIX_BITS) - 1)]++] = from[i];
+
+        Caption* temp = from;
+        from = to;
+        to = temp;
+    }
+
+    // An even number of passes leaves the result in table->data
+    free(scratch);
+    free(counts);
+
+    return table;
+}
\ No newline at end of file
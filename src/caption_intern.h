@@ -0,0 +1,16 @@
+#ifndef CAPTION_INTERN_H_INCLUDED
+#define CAPTION_INTERN_H_INCLUDED
+
+#include "caption_table.h"
+#include "thread_pool.h"
+
+// Interns the raw keys of several tables parsed without caption_hash, so each distinct key is
+// lowercased, hashed and sorted once no matter how many tables use it. Every caption's key and hash
+// are replaced by the interned ones and key_id is set to the key's rank in sorted order.
+// Returns the number of distinct keys, or -1 with errno set.
+int64_t caption_intern_keys(CaptionTable** tables, const uint32_t table_count, ThreadPool* pool);
+
+// Stable sort by key_id, the rank set by caption_intern_keys. Gives the order of caption_table_sort as long as no key repeats.
+CaptionTable* caption_intern_sort(CaptionTable* table);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <memory.h>
+#include "caption_layout.h"
+#include "valve_crc32.h"
+
+// Values are at most 4095 units plus the terminator
+#define MAX_VALUE_SIZE 4096
+#define DEDUP_EMPTY UINT32_MAX
+
+#define IS_SHARED(shared, i) ((shared) && (shared)[i] != (i))
+
+uint32_t* caption_layout_dedup(const CaptionTable* table, uint64_t* unique_count)
+{
+    const uint64_t n = table->size;
+
+    // Open addressing with linear probing on a CRC of the value, at most half full
+    uint64_t capacity = 16;
+    while(capacity < n << 1)
+        capacity <<= 1;
+
+    const uint64_t mask = capacity - 1;
+    uint32_t* shared = (uint32_t*)malloc((n ? n : 1) * sizeof(uint32_t));
+    uint32_t* hashes = (uint32_t*)malloc((n ? n : 1) * sizeof(uint32_t));
+    uint32_t* slots = (uint32_t*)malloc(capacity * sizeof(uint32_t));
+    if(!shared || !hashes || !slots)
+    {
+        free(shared);
+        free(hashes);
+        free(slots);
+        return NULL;
+    }
+
+    memset(slots, 0xFF, capacity * sizeof(uint32_t));
+
+    *unique_count = 0;
+    for(uint64_t i = 0; i < n; ++i)
+    {
+        const Caption* caption = &table->data[i];
+        hashes[i] = CRC32_ProcessSingleBuffer(caption->value, caption->value_size * sizeof(UChar));
+
+        register uint64_t slot = hashes[i] & mask;
+        while(slots[slot] != DEDUP_EMPTY)
+        {
+            const Caption* other = &table->data[slots[slot]];
+            if(hashes[slots[slot]] == hashes[i] && other->value_size == caption->value_size
+               && u_memcmp(other->value, caption->value, caption->value_size) == 0)
+                break;
+
+            slot = (slot + 1) & mask;
+        }
+
+        if(slots[slot] == DEDUP_EMPTY)
+        {
+            slots[slot] = i;
+            ++*unique_count;
+        }
+        shared[i] = slots[slot];
+    }
+
+    free(hashes);
+    free(slots);
+
+    return shared;
+}
+
+// Duplicates take over the slot of their first occurrence
+static void share_slots(CaptionTable* table, const uint32_t* shared)
+{
+    if(!shared)
+        return;
+
+    for(uint64_t i = 0; i < table->size; ++i)
+    {
+        const Caption* first = &table->data[shared[i]];
+        table->data[i].block = first->block;
+        table->data[i].offset = first->offset;
+    }
+}
+
+int32_t caption_layout_greedy(CaptionTable* table, const uint32_t* shared, const uint32_t block_size)
+{
+    int32_t block = 0;
+    uint32_t offset = 0;
+
+    for(uint64_t i = 0; i < table->size; ++i)
+    {
+        if(IS_SHARED(shared, i))
+            continue;
+
+        Caption* caption = &table->data[i];
+        const uint32_t length_bytes = (caption->value_size + 1) * sizeof(UChar);
+
+        if(offset + length_bytes > block_size)
+        {
+            ++block;
+            offset = 0;
+        }
+
+        caption->block = block;
+        caption->offset = offset;
+        offset += length_bytes;
+    }
+
+    share_slots(table, shared);
+
+    return block + 1;
+}
+
+int32_t caption_layout_pack(CaptionTable* table, const uint32_t* shared, const uint32_t block_size)
+{
+    uint64_t n = table->size;
+
+    // No value is bigger than a block, so there are never more blocks than values
+    uint64_t leaves = 1;
+    while(leaves < n)
+        leaves <<= 1;
+
+    uint32_t* order = (uint32_t*)malloc((n ? n : 1) * sizeof(uint32_t));
+    uint64_t* counts = (uint64_t*)calloc(MAX_VALUE_SIZE + 1, sizeof(uint64_t));
+    uint16_t* room = (uint16_t*)malloc(2 * leaves * sizeof(uint16_t));
+    if(!order || !counts || !room)
+    {
+        free(order);
+        free(counts);
+        free(room);
+        return -1;
+    }
+
+    // Counting sort by value size, longest first and table order within a size
+    for(uint64_t i = 0; i < table->size; ++i)
+    {
+        if(!IS_SHARED(shared, i))
+            ++counts[MAX_VALUE_SIZE - table->data[i].value_size];
+    }
+    uint64_t sum = 0;
+    for(uint64_t i = 0; i <= MAX_VALUE_SIZE; ++i)
+    {
+        const uint64_t count = counts[i];
+        counts[i] = sum;
+        sum += count;
+    }
+    n = sum;
+    for(uint64_t i = 0; i < table->size; ++i)
+    {
+        if(!IS_SHARED(shared, i))
+            order[counts[MAX_VALUE_SIZE - table->data[i].value_size]++] = i;
+    }
+
+    // Max segment tree over the room left in each block, leaves start at index leaves
+    for(uint64_t i = 1; i < 2 * leaves; ++i)
+        room[i] = block_size;
+
+    uint64_t block_count = 0;
+    for(uint64_t i = 0; i < n; ++i)
+    {
+        Caption* caption = &table->data[order[i]];
+        const uint16_t length_bytes = (caption->value_size + 1) * sizeof(UChar);
+
+        // Leftmost block with enough room; unopened blocks are empty, so one always exists
+        register uint64_t node = 1;
+        while(node < leaves)
+            node = (room[node << 1] >= length_bytes) ? node << 1 : (node << 1) + 1;
+
+        const uint64_t block = node - leaves;
+        caption->block = block;
+        caption->offset = block_size - room[node];
+        if(block >= block_count)
+            block_count = block + 1;
+
+        room[node] -= length_bytes;
+        for(node >>= 1; node; node >>= 1)
+            room[node] = (room[node << 1] > room[(node << 1) + 1]) ? room[node << 1] : room[(node << 1) + 1];
+    }
+
+    free(order);
+    free(counts);
+    free(room);
+
+    share_slots(table, shared);
+
+    return (block_count > 0) ? block_count : 1;
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#ifndef CAPTION_LAYOUT_H_INCLUDED
+#define CAPTION_LAYOUT_H_INCLUDED
+
+#include "caption_table.h"
+
+// For every caption, the index of the first caption with an identical value (itself if there is none).
+// Returns NULL with errno set on failure; the array is released with free.
+uint32_t* caption_layout_dedup(const CaptionTable* table, uint64_t* unique_count);
+
+// Both set block and offset of every caption and return the number of blocks used, or -1 with errno set.
+// Each value takes (value_size + 1) UChars and never crosses a block boundary. With shared from
+// caption_layout_dedup only first occurrences get space, the rest point at the same slot.
+
+// Fills blocks in table order, starting a new block whenever a value doesn't fit the current one
+int32_t caption_layout_greedy(CaptionTable* table, const uint32_t* shared, const uint32_t block_size);
+
+// First-fit decreasing: longest values first, each into the lowest block with room left
+int32_t caption_layout_pack(CaptionTable* table, const uint32_t* shared, const uint32_t block_size);
+
+#endif
\ No newline at end of file
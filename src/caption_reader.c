@@ -0,0 +1,288 @@
+#include <stdlib.h>
+#include <memory.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "caption_reader.h"
+
+#define NO_SLOT UINT32_MAX
+#define KEY_BUFFER_SIZE 256
+
+static int8_t read_at(const int fd, void* data, uint64_t size, uint64_t offset)
+{
+    while(size)
+    {
+        const ssize_t n = pread(fd, data, size, offset);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+        {
+            if(n == 0)
+                errno = EBADMSG;
+            return 0;
+        }
+
+        data = (char*)data + n;
+        size -= n;
+        offset += n;
+    }
+
+    return 1;
+}
+
+CaptionReader* caption_reader_open(const char* path, const uint32_t cache_blocks)
+{
+    CaptionReader* reader = (CaptionReader*)calloc(1, sizeof(CaptionReader));
+    char* directory = NULL;
+    if(!reader)
+        return NULL;
+
+    reader->fd = open(path, O_RDONLY);
+    if(reader->fd < 0)
+        goto caption_reader_open_error;
+
+    struct stat st;
+    if(fstat(reader->fd, &st) != 0 || !read_at(reader->fd, &reader->header, HEADER_SIZE, 0))
+        goto caption_reader_open_error;
+
+    const Header* header = &reader->header;
+    if(!dat_file_check_header(header, st.st_size))
+    {
+        errno = EBADMSG;
+        goto caption_reader_open_error;
+    }
+
+    const uint64_t entry_count = header->dir_size;
+    directory = (char*)malloc(entry_count * DIR_ENTRY_SIZE + 1);
+    reader->entries = (DatEntry*)malloc((entry_count ? entry_count : 1) * sizeof(DatEntry));
+    if(!directory || !reader->entries || !read_at(reader->fd, directory, entry_count * DIR_ENTRY_SIZE, HEADER_SIZE))
+        goto caption_reader_open_error;
+
+    // Bad ranges are caught once here, so lookups only have to check the terminator
+    for(uint64_t i = 0; i < entry_count; ++i)
+    {
+        DatEntry* entry = &reader->entries[i];
+        const char* data = directory + i * DIR_ENTRY_SIZE;
+        memcpy(&entry->hash, data, sizeof(uint32_t));
+        memcpy(&entry->block, data + 4, sizeof(int32_t));
+        memcpy(&entry->offset, data + 8, sizeof(int16_t));
+        memcpy(&entry->length, data + 10, sizeof(int16_t));
+
+        if(!dat_file_check_entry(header, entry))
+        {
+            errno = EBADMSG;
+            goto caption_reader_open_error;
+        }
+    }
+
+    free(directory);
+    directory = NULL;
+
+    if(!dat_file_sort_entries(&reader->entries, entry_count))
+        goto caption_reader_open_error;
+
+    // dat_file_check_header has made sure the count isn't negative
+    const uint32_t block_count = header->block_count;
+    reader->slot_count = (cache_blocks < block_count) ? cache_blocks : block_count;
+    if(reader->slot_count == 0)
+        reader->slot_count = 1;
+
+    reader->blocks = (char*)malloc((uint64_t)reader->slot_count * header->block_size);
+    reader->block_slots = (int32_t*)malloc((header->block_count ? header->block_count : 1) * sizeof(int32_t));
+    reader->slot_blocks = (int32_t*)malloc(reader->slot_count * sizeof(int32_t));
+    reader->newer = (uint32_t*)malloc(reader->slot_count * sizeof(uint32_t));
+    reader->older = (uint32_t*)malloc(reader->slot_count * sizeof(uint32_t));
+    if(!reader->blocks || !reader->block_slots || !reader->slot_blocks || !reader->newer || !reader->older)
+        goto caption_reader_open_error;
+
+    for(int32_t i = 0; i < header->block_count; ++i)
+        reader->block_slots[i] = -1;
+    reader->newest = reader->oldest = NO_SLOT;
+
+    return reader;
+
+    caption_reader_open_error:
+    {
+        const int error = errno;
+        free(directory);
+        caption_reader_destroy(&reader);
+        errno = error;
+    }
+
+    return NULL;
+}
+
+static void unlink_slot(CaptionReader* self, const uint32_t slot)
+{
+    const uint32_t newer = self->newer[slot];
+    const uint32_t older = self->older[slot];
+
+    if(newer != NO_SLOT)
+        self->older[newer] = older;
+    else
+        self->newest = older;
+
+    if(older != NO_SLOT)
+        self->newer[older] = newer;
+    else
+        self->oldest = newer;
+}
+
+static void push_newest(CaptionReader* self, const uint32_t slot)
+{
+    self->newer[slot] = NO_SLOT;
+    self->older[slot] = self->newest;
+    if(self->newest != NO_SLOT)
+        self->newer[self->newest] = slot;
+    else
+        self->oldest = slot;
+    self->newest = slot;
+}
+
+// The cached copy of a block, read from the file into the least recently used slot on a miss
+static const char* load_block(CaptionReader* self, const int32_t block)
+{
+    const uint32_t block_size = self->header.block_size;
+    uint32_t slot;
+
+    if(__builtin_expect(self->block_slots[block] >= 0, 1))
+    {
+        ++self->hits;
+        slot = self->block_slots[block];
+        if(slot != self->newest)
+        {
+            unlink_slot(self, slot);
+            push_newest(self, slot);
+        }
+
+        return self->blocks + (uint64_t)slot * block_size;
+    }
+
+    ++self->misses;
+    if(self->slots_used < self->slot_count)
+        slot = self->slots_used++;
+    else
+    {
+        slot = self->oldest;
+        unlink_slot(self, slot);
+        if(self->slot_blocks[slot] >= 0)
+            self->block_slots[self->slot_blocks[slot]] = -1;
+    }
+
+    // A failed read leaves the slot empty
+    char* data = self->blocks + (uint64_t)slot * block_size;
+    const int8_t loaded = read_at(self->fd, data, block_size, self->header.data_offset + (uint64_t)block * block_size);
+    self->slot_blocks[slot] = loaded ? block : -1;
+    if(loaded)
+        self->block_slots[block] = slot;
+    push_newest(self, slot);
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for(uint32_t i = 0; loaded && i < block_size; i += sizeof(UChar))
+        *(UChar*)(data + i) = __builtin_bswap16(*(UChar*)(data + i));
+#endif
+
+    return loaded ? data : NULL;
+}
+
+int32_t caption_reader_find_hash(CaptionReader* self, const uint32_t hash, UChar* value, const uint32_t capacity)
+{
+    uint64_t low = 0, high = self->header.dir_size;
+    while(low < high)
+    {
+        const uint64_t middle = (low + high) >> 1;
+        if(self->entries[middle].hash < hash)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    if(low == (uint64_t)self->header.dir_size || self->entries[low].hash != hash)
+    {
+        errno = ENOENT;
+        return -1;
+    }
+
+    const DatEntry* entry = &self->entries[low];
+    const char* block = load_block(self, entry->block);
+    if(!block)
+        return -1;
+
+    const UChar* data = (const UChar*)(block + entry->offset);
+    const int32_t length = entry->length / sizeof(UChar) - 1;
+    if(data[length] != 0)
+    {
+        errno = EBADMSG;
+        return -1;
+    }
+
+    if(capacity)
+    {
+        const uint32_t copied = ((uint32_t)length < capacity) ? (uint32_t)length : capacity - 1;
+        memcpy(value, data, copied * sizeof(UChar));
+        value[copied] = 0;
+    }
+
+    return length;
+}
+
+int8_t caption_reader_hash(const char* key, uint32_t* hash)
+{
+    UChar buffer[KEY_BUFFER_SIZE];
+    UErrorCode error = U_ZERO_ERROR;
+    int32_t length = 0;
+
+    // Keys up to the buffer size are converted in one go, longer ones measured and converted into the heap
+    u_strFromUTF8(buffer, KEY_BUFFER_SIZE, &length, key, -1, &error);
+    UChar* data = buffer;
+    if(error == U_BUFFER_OVERFLOW_ERROR)
+    {
+        data = (UChar*)malloc(length * sizeof(UChar));
+        if(!data)
+            return 0;
+
+        error = U_ZERO_ERROR;
+        u_strFromUTF8(data, length, NULL, key, -1, &error);
+    }
+
+    Caption caption;
+    caption.key = data;
+    caption.key_size = length;
+
+    // caption_hash sets errno itself when it fails
+    const int8_t hashed = !U_FAILURE(error) && caption_hash(&caption);
+    if(U_FAILURE(error))
+        errno = EILSEQ;
+    if(hashed)
+        *hash = caption.hash;
+
+    if(data != buffer)
+        free(data);
+
+    return hashed;
+}
+
+int32_t caption_reader_find(CaptionReader* self, const char* key, UChar* value, const uint32_t capacity)
+{
+    uint32_t hash;
+    if(!caption_reader_hash(key, &hash))
+        return -1;
+
+    return caption_reader_find_hash(self, hash, value, capacity);
+}
+
+void caption_reader_destroy(CaptionReader** self)
+{
+    if((*self)->fd >= 0)
+        close((*self)->fd);
+
+    free((*self)->entries);
+    free((*self)->blocks);
+    free((*self)->block_slots);
+    free((*self)->slot_blocks);
+    free((*self)->newer);
+    free((*self)->older);
+    free(*self);
+    *self = NULL;
+}
\ No newline at end of file
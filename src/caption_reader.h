@@ -0,0 +1,38 @@
+#ifndef CAPTION_READER_H_INCLUDED
+#define CAPTION_READER_H_INCLUDED
+
+#include "dat_file.h"
+
+// Looks captions up in a .dat the way the engine does: the directory is loaded and sorted by hash,
+// and blocks are read from the file on demand into a bounded cache that drops the least recently used.
+// A reader is not safe to share between threads.
+typedef struct _CaptionReader {
+    int fd;
+    Header header;
+    DatEntry* entries;
+    char* blocks;
+    int32_t* block_slots;
+    int32_t* slot_blocks;
+    uint32_t* newer;
+    uint32_t* older;
+    uint32_t newest, oldest;
+    uint32_t slot_count, slots_used;
+    uint64_t hits, misses;
+} CaptionReader;
+
+// Opens path, keeping at most cache_blocks blocks in memory. Returns NULL with errno set, EBADMSG if it isn't a valid .dat.
+CaptionReader* caption_reader_open(const char* path, const uint32_t cache_blocks);
+
+// Copies the value for hash into value, cut to capacity - 1 UChars and always terminated.
+// Returns the full length of the value, or -1 with errno set to ENOENT if there is none.
+int32_t caption_reader_find_hash(CaptionReader* self, const uint32_t hash, UChar* value, const uint32_t capacity);
+
+// Same for a UTF-8 key, hashed like caption_hash
+int32_t caption_reader_find(CaptionReader* self, const char* key, UChar* value, const uint32_t capacity);
+
+// Hash of a UTF-8 key as stored in the directory. Returns 0 with errno set and hash untouched if it can't be hashed.
+int8_t caption_reader_hash(const char* key, uint32_t* hash);
+
+void caption_reader_destroy(CaptionReader** self);
+
+#endif
\ No newline at end of file
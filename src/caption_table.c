@@ -0,0 +1,378 @@
+#include <stdlib.h>
+#include <memory.h>
+#include "caption_table.h"
+
+#define TABLE_INITIAL_CAPACITY 64
+
+CaptionTable* caption_table_init(const uint64_t capacity)
+{
+    CaptionTable* table = (CaptionTable*)malloc(sizeof(CaptionTable));
+    if(__builtin_expect(table != NULL, 0))
+    {
+        table->size = 0;
+        table->capacity = (capacity > TABLE_INITIAL_CAPACITY) ? capacity : TABLE_INITIAL_CAPACITY;
+        table->data = (Caption*)malloc(table->capacity * sizeof(Caption));
+        if(!table->data)
+        {
+            free(table);
+            table = NULL;
+        }
+    }
+
+    return table;
+}
+
+static CaptionTable* reserve(CaptionTable* table, const uint64_t n)
+{
+    if(n <= table->capacity)
+        return table;
+
+    uint64_t new_capacity = table->capacity << 1;
+    if(new_capacity < n)
+        new_capacity = n;
+
+    Caption* new_data = (Caption*)realloc(table->data, new_capacity * sizeof(Caption));
+    if(!new_data)
+        return NULL;
+
+    table->data = new_data;
+    table->capacity = new_capacity;
+
+    return table;
+}
+
+CaptionTable* caption_table_push(CaptionTable* table, const Caption* caption)
+{
+    if(__builtin_expect(table->size == table->capacity, 0) && !reserve(table, table->size + 1))
+        return NULL;
+
+    table->data[table->size++] = *caption;
+
+    return table;
+}
+
+CaptionTable* caption_table_append(CaptionTable* table, const CaptionTable* other)
+{
+    if(!reserve(table, table->size + other->size))
+        return NULL;
+
+    memcpy(table->data + table->size, other->data, other->size * sizeof(Caption));
+    table->size += other->size;
+
+    return table;
+}
+
+// Multikey quicksort over the UTF-16 keys. Each entry caches the three code units at the
+// current depth packed into 17 bits apiece (unit + 1, 0 once the key has ended), so most
+// comparisons never touch the key itself. Every entry in a partition shares the first depth
+// units, and equal keys end up in reverse table order, which is what the old merge sort gave.
+#define CACHE_UNITS 3
+#define CACHE_UNIT_BITS 17
+#define CACHE_UNIT_MASK ((1u << CACHE_UNIT_BITS) - 1)
+#define INSERTION_SORT_SIZE 16
+
+#define PARALLEL_SORT_SIZE 65536
+#define SAMPLES_PER_BUCKET 64
+#define BUCKETS_PER_THREAD 4
+
+typedef struct _SortEntry {
+    uint64_t cache;
+    uint32_t index;
+} SortEntry;
+
+typedef struct _SortTask {
+    const Caption* captions;
+    SortEntry* entries;
+    SortEntry* sorted;
+    uint16_t* buckets;
+    const SortEntry* splitters;
+    uint64_t count;
+    uint32_t splitter_count;
+} SortTask;
+
+static inline uint64_t key_cache(const Caption* caption, const uint32_t depth)
+{
+    uint64_t cache = 0;
+    for(uint32_t i = depth; i < depth + CACHE_UNITS; ++i)
+    {
+        cache <<= CACHE_UNIT_BITS;
+        if(i < caption->key_size)
+            cache |= (uint64_t)caption->key[i] + 1;
+    }
+
+    return cache;
+}
+
+// Full order from depth on: key first, then later table position first
+static inline int32_t compare_entries(const Caption* captions, const SortEntry* a, const SortEntry* b, const uint32_t depth)
+{
+    const Caption* left = &captions[a->index];
+    const Caption* right = &captions[b->index];
+    const uint32_t min_length = (left->key_size < right->key_size) ? left->key_size : right->key_size;
+
+    int32_t result = (min_length > depth) ? u_memcmp(left->key + depth, right->key + depth, min_length - depth) : 0;
+    if(result == 0)
+        result = (int32_t)left->key_size - (int32_t)right->key_size;
+    if(result == 0)
+        result = (a->index < b->index) - (a->index > b->index);
+
+    return result;
+}
+
+// Equal keys: later table position first
+static int compare_indices(const void* a, const void* b)
+{
+    const uint32_t left = ((const SortEntry*)a)->index;
+    const uint32_t right = ((const SortEntry*)b)->index;
+
+    return (left < right) - (left > right);
+}
+
+static void insertion_sort(const Caption* captions, SortEntry* entries, const uint64_t n, const uint32_t depth)
+{
+    for(uint64_t i = 1; i < n; ++i)
+    {
+        const SortEntry entry = entries[i];
+        uint64_t j = i;
+        while(j > 0 && compare_entries(captions, &entry, &entries[j - 1], depth) < 0)
+        {
+            entries[j] = entries[j - 1];
+            --j;
+        }
+        entries[j] = entry;
+    }
+}
+
+static inline void swap_entries(SortEntry* a, SortEntry* b)
+{
+    const SortEntry temp = *a;
+    *a = *b;
+    *b = temp;
+}
+
+// Moves past the cached units and caches the next ones of each key
+static uint32_t next_depth(const Caption* captions, SortEntry* entries, const uint64_t n, uint32_t depth)
+{
+    depth += CACHE_UNITS;
+    for(uint64_t i = 0; i < n; ++i)
+        entries[i].cache = key_cache(&captions[entries[i].index], depth);
+
+    return depth;
+}
+
+static void multikey_sort(const Caption* captions, SortEntry* entries, uint64_t n, uint32_t depth)
+{
+    while(n > INSERTION_SORT_SIZE)
+    {
+        // Median of three
+        uint64_t a = entries[0].cache, b = entries[n >> 1].cache, c = entries[n - 1].cache;
+        const uint64_t pivot = (a < b) ? ((b < c) ? b : (a < c) ? c : a) : ((a < c) ? a : (b < c) ? c : b);
+
+        uint64_t less = 0, i = 0, greater = n;
+        while(i < greater)
+        {
+            if(entries[i].cache < pivot)
+                swap_entries(&entries[less++], &entries[i++]);
+            else if(entries[i].cache > pivot)
+                swap_entries(&entries[i], &entries[--greater]);
+            else
+                ++i;
+        }
+
+        SortEntry* const equal = entries + less;
+        const uint64_t lower_count = less, equal_count = greater - less, upper_count = n - greater;
+        // Key ended inside the cached units, so the whole equal partition has the same key
+        const int keys_ended = (pivot & CACHE_UNIT_MASK) == 0;
+
+        // Recurse into the two smaller partitions, neither more than half of n, and loop on the
+        // largest, so the stack stays within log2(n) frames however the keys are distributed
+        if(equal_count >= lower_count && equal_count >= upper_count)
+        {
+            multikey_sort(captions, entries, lower_count, depth);
+            multikey_sort(captions, entries + greater, upper_count, depth);
+
+            if(keys_ended)
+            {
+                qsort(equal, equal_count, sizeof(SortEntry), compare_indices);
+                return;
+            }
+
+            entries = equal;
+            n = equal_count;
+            depth = next_depth(captions, entries, n, depth);
+        }
+        else
+        {
+            if(keys_ended)
+                qsort(equal, equal_count, sizeof(SortEntry), compare_indices);
+            else
+                multikey_sort(captions, equal, equal_count, next_depth(captions, equal, equal_count, depth));
+
+            if(lower_count < upper_count)
+            {
+                multikey_sort(captions, entries, lower_count, depth);
+                entries += greater;
+                n = upper_count;
+            }
+            else
+            {
+                multikey_sort(captions, entries + greater, upper_count, depth);
+                n = lower_count;
+            }
+        }
+    }
+
+    insertion_sort(captions, entries, n, depth);
+}
+
+static void classify_task(void* data)
+{
+    SortTask* task = (SortTask*)data;
+    for(uint64_t i = 0; i < task->count; ++i)
+    {
+        SortEntry* entry = &task->entries[i];
+        entry->cache = key_cache(&task->captions[entry->index], 0);
+
+        uint32_t low = 0, high = task->splitter_count;
+        while(low < high)
+        {
+            const uint32_t middle = (low + high) >> 1;
+            if(compare_entries(task->captions, &task->splitters[middle], entry, 0) < 0)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        task->buckets[i] = low;
+    }
+}
+
+static void sort_task(void* data)
+{
+    SortTask* task = (SortTask*)data;
+    multikey_sort(task->captions, task->sorted, task->count, 0);
+}
+
+// Sample sort: splitters taken from a sorted sample cut the table into buckets that
+// are already in final order relative to each other, then each bucket is sorted on its own
+static SortEntry* parallel_sort(const Caption* captions, SortEntry* entries, const uint64_t n, ThreadPool* pool)
+{
+    const uint32_t thread_count = pool->thread_count + 1;
+    const uint32_t bucket_count = thread_count * BUCKETS_PER_THREAD;
+    const uint32_t sample_count = bucket_count * SAMPLES_PER_BUCKET;
+
+    SortEntry* sorted = (SortEntry*)malloc(n * sizeof(SortEntry));
+    uint16_t* buckets = (uint16_t*)malloc(n * sizeof(uint16_t));
+    SortEntry* splitters = (SortEntry*)malloc(sample_count * sizeof(SortEntry));
+    SortTask* tasks = (SortTask*)malloc(bucket_count * sizeof(SortTask));
+    uint64_t* offsets = (uint64_t*)calloc(bucket_count + 1, sizeof(uint64_t));
+    if(!sorted || !buckets || !splitters || !tasks || !offsets)
+    {
+        free(sorted);
+        sorted = NULL;
+        goto parallel_sort_end;
+    }
+
+    for(uint32_t i = 0; i < sample_count; ++i)
+    {
+        splitters[i].index = entries[(n / sample_count) * i].index;
+        splitters[i].cache = key_cache(&captions[splitters[i].index], 0);
+    }
+    multikey_sort(captions, splitters, sample_count, 0);
+
+    for(uint32_t i = 1; i < bucket_count; ++i)
+        splitters[i - 1] = splitters[i * SAMPLES_PER_BUCKET];
+
+    // Classify ranges of the table in parallel
+    for(uint32_t i = 0; i < thread_count; ++i)
+    {
+        const uint64_t start = n * i / thread_count;
+        tasks[i] = (SortTask){captions, entries + start, NULL, buckets + start, splitters, n * (i + 1) / thread_count - start, bucket_count - 1};
+    }
+    thread_pool_run(pool, classify_task, tasks, sizeof(SortTask), thread_count);
+
+    for(uint64_t i = 0; i < n; ++i)
+        ++offsets[buckets[i] + 1];
+    for(uint32_t i = 0; i < bucket_count; ++i)
+        offsets[i + 1] += offsets[i];
+
+    for(uint32_t i = 0; i < bucket_count; ++i)
+        tasks[i] = (SortTask){captions, NULL, sorted + offsets[i], NULL, NULL, offsets[i + 1] - offsets[i], 0};
+
+    // Scatter, keeping table order inside each bucket
+    for(uint64_t i = 0; i < n; ++i)
+        sorted[offsets[buckets[i]]++] = entries[i];
+
+    thread_pool_run(pool, sort_task, tasks, sizeof(SortTask), bucket_count);
+
+    parallel_sort_end:
+    {
+        free(buckets);
+        free(splitters);
+        free(tasks);
+        free(offsets);
+    }
+
+    return sorted;
+}
+
+CaptionTable* caption_table_sort(CaptionTable* table, ThreadPool* pool)
+{
+    const uint64_t n = table->size;
+    if(n < 2)
+        return table;
+
+    SortEntry* entries = (SortEntry*)malloc(n * sizeof(SortEntry));
+    Caption* scratch = (Caption*)malloc(n * sizeof(Caption));
+    if(!entries || !scratch)
+    {
+        free(entries);
+        free(scratch);
+        return NULL;
+    }
+
+    for(uint64_t i = 0; i < n; ++i)
+        entries[i].index = i;
+
+    SortEntry* sorted = entries;
+    if(pool && pool->thread_count && n >= PARALLEL_SORT_SIZE)
+    {
+        sorted = parallel_sort(table->data, entries, n, pool);
+        if(!sorted)
+        {
+            free(entries);
+            free(scratch);
+            return NULL;
+        }
+    }
+    else
+    {
+        for(uint64_t i = 0; i < n; ++i)
+            entries[i].cache = key_cache(&table->data[i], 0);
+        multikey_sort(table->data, entries, n, 0);
+    }
+
+    for(uint64_t i = 0; i < n; ++i)
+        scratch[i] = table->data[sorted[i].index];
+
+    free(table->data);
+    table->data = scratch;
+    table->capacity = n;
+
+    if(sorted != entries)
+        free(sorted);
+    free(entries);
+
+    return table;
+}
+
+void caption_table_empty(CaptionTable* table)
+{
+    table->size = 0;
+}
+
+void caption_table_destroy(CaptionTable** table)
+{
+    free((*table)->data);
+    free(*table);
+    *table = NULL;
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#ifndef CAPTION_TABLE_H_INCLUDED
+#define CAPTION_TABLE_H_INCLUDED
+
+#include "caption.h"
+#include "thread_pool.h"
+
+// Contiguous array of captions, released with a single free
+typedef struct _CaptionTable {
+    Caption* data;
+    uint64_t size;
+    uint64_t capacity;
+} CaptionTable;
+
+CaptionTable* caption_table_init(const uint64_t capacity);
+CaptionTable* caption_table_push(CaptionTable* table, const Caption* caption);
+CaptionTable* caption_table_append(CaptionTable* table, const CaptionTable* other);
+CaptionTable* caption_table_sort(CaptionTable* table, ThreadPool* pool);
+
+void caption_table_empty(CaptionTable* table);
+void caption_table_destroy(CaptionTable** table);
+
+#endif
\ No newline at end of file
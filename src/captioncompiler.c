@@ -3,31 +3,61 @@
  * Created:   7/8/2023
  */
 
+#include <stdlib.h>
 #include <ctype.h>
 #include <memory.h>
 #include <errno.h>
-#include "buffer.h"
-#include "caption_list.h"
-
-#define VCCD 1145258838
-#define VERSION 1
-#define BLOCK_SIZE 8192
-#define DIR_ENTRY_SIZE (4+4+2+2)
-#define HEADER_SIZE 24
-
-#define INITIAL_BUFFER_SIZE 5000
-
-typedef struct _Header {
-    int32_t vccd, version;
-    int32_t block_count, block_size;
-    int32_t dir_size;
-    int32_t data_offset;
-} Header;
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include "caption_compile.h"
+#include "caption_intern.h"
+#include "compile_stats.h"
+#include "dat_file.h"
+#include "fingerprint.h"
+#include "thread_pool.h"
+
+#define MAX_THREADS 256
+
+#define WATCH_DEBOUNCE_MS 100
+#define WATCH_BUFFER_SIZE 16384
+
+#define SERVE_MAGIC 0x56524553 // "SERV"
+#define SERVE_BACKLOG 64
 
 typedef enum _CompilerFlags {
-    Verbose = 0x01,
+    Verbose = CompileVerbose,
+    Pack = CompilePack,
+    Dedup = CompileDedup,
+    SharedKeys = CompileSharedKeys,
+    Cache = 0x10,
+    Watch = 0x20,
+    Verify = 0x40,
 } CompilerFlags;
 
+typedef enum _RunMode {
+    ModeCompile = 0,
+    ModeServe,
+    ModeClient,
+    ModeDecompile,
+    ModeDiff,
+} RunMode;
+
+typedef enum _StatsOutput {
+    StatsOff = 0,
+    StatsTable,
+    StatsJson,
+} StatsOutput;
+
 typedef enum _ParserErrors {
     ArgCount = 0x01,
     InvalidArg = 0x02,
@@ -39,355 +69,1282 @@ typedef struct _ParserErrorData {
     char* argument;
 } ParserErrorData;
 
-Caption* extract_strings(Caption* caption, const UString* line, int8_t* error)
+// One language of a batch compile
+typedef struct _LanguageTask {
+    const char* filename;
+    char* out_filepath;
+    char* cache_filepath;
+    SourceFile* source;
+    CaptionTable* table;
+    ThreadPool* pool;
+    DuplicatePolicy policy;
+    uint64_t source_fingerprint;
+    uint8_t flags;
+    CompileStatus status;
+    CompileStats* stats;
+    int8_t failed;
+    int8_t up_to_date;
+} LanguageTask;
+
+// An input of watch mode, found in inotify events by its directory's watch and its name
+typedef struct _WatchedFile {
+    const char* filepath;
+    const char* name;
+    int directory;
+    CaptionCache* state;
+    double changed_at;
+    int8_t pending;
+} WatchedFile;
+
+// Sent by --client for every file, followed by the path_length bytes of its absolute path
+typedef struct _ServeRequest {
+    uint32_t magic;
+    uint32_t flags;
+    uint32_t policy;
+    uint32_t path_length;
+} ServeRequest;
+
+// Answer to one request. line is where a parse error or the second definition of a key was found,
+// the counts come from the header of the .dat.
+typedef struct _ServeReply {
+    uint32_t magic;
+    uint32_t error;
+    uint32_t line;
+    int32_t system_error;
+    uint32_t entry_count;
+    uint32_t block_count;
+    uint64_t output_size;
+    double milliseconds;
+} ServeReply;
+
+// A language the server has compiled before, with the sort order of its last build
+typedef struct _ServedFile {
+    char* filepath;
+    CaptionCache* state;
+} ServedFile;
+
+// Set by SIGINT or SIGTERM in the modes that stay running
+static volatile sig_atomic_t stop_requested = 0;
+
+// Allocations made by the compiler and the library linked into it, counted for --stats. The makefile
+// links the executable with --wrap for malloc, calloc and realloc, so their calls land here first.
+static uint8_t count_allocations = 0;
+static uint64_t allocation_count = 0, reallocation_count = 0;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* data, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    if(__builtin_expect(count_allocations, 0))
+        __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+    if(__builtin_expect(count_allocations, 0))
+        __atomic_fetch_add(&allocation_count, 1, __ATOMIC_RELAXED);
+
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* data, size_t size)
+{
+    if(__builtin_expect(count_allocations, 0))
+        __atomic_fetch_add(&reallocation_count, 1, __ATOMIC_RELAXED);
+
+    return __real_realloc(data, size);
+}
+
+static void print_read_error(const char* filename, const CompileStatus* status)
 {
-    // Key
-    caption->key = ustring_init_prealloced(line->size);
-    if(!caption->key)
+    switch(status->code) 
     {
-        *error = 1;
+        case CompileValueTooLong:
+            fprintf(stderr, "An error occured while reading file '%s': Value at line %u exceeds maximum length of %u\n", filename, status->line, (BLOCK_SIZE >> 1) - 1);
+            break;
+        case CompileNoTokens:
+            fprintf(stderr, "An error occured while reading file '%s': Could not find token declaration\n", filename);
+            break;
+        case CompileEmptyKey:
+            fprintf(stderr, "An error occured while reading file '%s': Line %u has a key of length 0\n", filename, status->line);
+            break;
+        case CompileDuplicateKey:
+        case CompileHashCollision:
+        {
+            const Caption* first = &status->conflict.first;
+            const Caption* second = &status->conflict.second;
+            UFILE* error_file = u_finit(stderr, NULL, NULL);
+
+            if(status->code == CompileDuplicateKey)
+                u_fprintf(error_file, "An error occured while reading file '%s': Key '%.*S' at line %u is already defined at line %u\n", filename, second->key_size, second->key, second->line, first->line);
+            else
+                u_fprintf(error_file, "An error occured while reading file '%s': Keys '%.*S' at line %u and '%.*S' at line %u have the same hash %u\n", filename, first->key_size, first->key, first->line, second->key_size, second->key, second->line, first->hash);
+
+            u_fclose(error_file);
+            break;
+        }
+        default:
+            fprintf(stderr, "An error occured while reading file '%s': %s\n", filename, strerror(status->system_error));
+            break;
+    }
+}
+
+static void set_system_error(CompileStatus* status, const int error)
+{
+    status->code = CompileSystemError;
+    status->system_error = error;
+    status->line = 0;
+}
+
+static CaptionTable* finish_captions(const char* filename, CaptionTable* table, ThreadPool* pool, const CaptionCache* cache, DuplicatePolicy policy, uint8_t flags, CompileStatus* status, CompileStats* stats)
+{
+    const uint64_t start = compile_stats_start(stats);
+    if(!caption_compile_finish(table, pool, cache, policy, flags, status))
+    {
+        print_read_error(filename, status);
         return NULL;
     }
+    compile_stats_stage(stats, StageSort, start);
 
-    register const UChar* data = line->data;
-    register UChar* new_data = caption->key->data;
+    return table;
+}
 
-    // Skip any whitespace characters until start of key
-    while(u_isspace(*data))
-        ++data;
+// Parses every caption in file order. *source may already hold the opened file, it is
+// taken over either way and only handed back on success. When timed, keys are hashed
+// in a pass of their own after parsing instead of as each line is parsed.
+static CaptionTable* read_captions(const char* filename, SourceFile** source, ThreadPool* pool, uint8_t flags, CompileStatus* status, CompileStats* stats)
+{
+    SourceFile* txt_file = *source;
+    uint64_t start = compile_stats_start(stats);
 
-    if(*data == '\0' || *data == '/' || *data == '{' || *data == '}')
+    *source = NULL;
+    if(!txt_file)
+        txt_file = source_file_init(filename);
+    if(!txt_file)
+    {
+        set_system_error(status, errno);
+        print_read_error(filename, status);
         return NULL;
+    }
 
-    if(*data == '\"')
-        ++data;
-
-    // Copy lowercase char to dest until end of key is found
-    while(*data != '\"' && !u_isspace(*data) && *data != '\0')
-        *new_data++ = u_tolower(*data++);
+    // Byte order mark
+    source_file_skip(txt_file, 1);
+    start = compile_stats_stage(stats, StageRead, start);
 
-    if(*data == '\"')
-        ++data;
-    
-    *new_data = '\0';
-    caption->key->size = new_data - caption->key->data;
-    ustring_shrink_to_fit(caption->key);
+    const uint8_t hash_apart = stats && !(flags & SharedKeys);
+    CaptionTable* table = caption_compile_parse(txt_file, pool, hash_apart ? flags | SharedKeys : flags, status);
+    if(table && stats)
+    {
+        stats->lines += status->line;
+        stats->bytes_in += txt_file->size * sizeof(UChar);
+        start = compile_stats_stage(stats, StageParse, start);
+    }
 
-    if(caption->key->size == 0)
+    if(table && hash_apart)
     {
-        *error = 1;
-        errno = EINVAL;
-        return NULL;
+        if(!caption_compile_hash(table, pool, status))
+            caption_table_destroy(&table);
+        compile_stats_stage(stats, StageHash, start);
     }
-    else if(u_strncmp(caption->key->data, u"[english]", 9) == 0)
-        return NULL;
 
-    // Value
-    caption->value = ustring_init_prealloced(line->size - caption->key->size);
-    if(!caption->value)
+    if(!table)
     {
-        *error = 1;
+        print_read_error(filename, status);
+        source_file_destroy(&txt_file);
         return NULL;
     }
 
-    new_data = caption->value->data;
+    // Captions point into the source, so it has to outlive them
+    *source = txt_file;
 
-    // Skip any whitespace characters until start of value
-    while(u_isspace(*data))
-        ++data;
+    return table;
+}
 
-    if(*data == '\"')
-        ++data;
+// Maps the written file and checks it entry by entry against the table and header it was written from
+static int8_t verify_output(const CaptionTable* captions, const Header* header, const char* filepath, ThreadPool* pool, uint8_t flags, CompileStatus* status)
+{
+    static const char* const reasons[] = {"matches", "is out of order", "points to the wrong place", "is out of bounds or not terminated", "has the wrong value"};
+    uint64_t first_index = 0;
+    DatMismatch first_mismatch = DatMatch;
+    int64_t bad_count = -1;
 
-    // Copy char to dest until end of value is found
-    while(*data != '\"' && *data != '\0')
-        *new_data++ = *data++;
+    DatFile* file = dat_file_open(filepath);
+    if(file && memcmp(&file->header, header, HEADER_SIZE) != 0)
+    {
+        dat_file_destroy(&file);
+        errno = EBADMSG;
+    }
 
-    *new_data = '\0';
-    caption->value->size = new_data - caption->value->data;
-    ustring_shrink_to_fit(caption->value);
+    if(file)
+        bad_count = dat_file_verify(file, captions, pool, &first_index, &first_mismatch);
 
-    if(caption->value->size == 0)
-        caption = NULL;
-    else if(caption->value->size + 1 > (BLOCK_SIZE >> 1))
+    if(bad_count < 0)
     {
-        *error = 1;
-        errno = EOVERFLOW;
-        caption = NULL;
+        set_system_error(status, errno);
+        fprintf(stderr, "An error occured while verifying file '%s': %s\n", filepath, (errno == EBADMSG) ? "Header doesn't match the compiled data" : strerror(errno));
     }
+    else if(bad_count > 0)
+    {
+        set_system_error(status, EIO);
+        fprintf(stderr, "An error occured while verifying file '%s': %ld entries don't match the source, the first one (entry %lu, hash %u) %s\n",
+                filepath, bad_count, first_index, (first_index < captions->size) ? captions->data[first_index].hash : 0, reasons[first_mismatch]);
+    }
+    else if(flags & Verbose)
+        u_fprintf(u_get_stdout(), "Verified %lu entries of '%s'\n", captions->size, filepath);
+
+    if(file)
+        dat_file_destroy(&file);
 
-    return caption;
+    return bad_count == 0;
 }
 
-Caption* parse_caption(const UString* line, int8_t* error)
+static int8_t compile(CaptionTable* captions, const char* filepath, ThreadPool* pool, uint8_t flags, CompileStatus* status, CompileStats* stats)
 {
-    *error = 0;
-    Caption* caption = caption_init();
-    if(!caption)
+    uint64_t start = compile_stats_start(stats);
+    CompileLayout layout = {0};
+    int out_file = -1;
+    char* data = NULL;
+
+    int8_t temp_created = 0;
+
+    // Hidden and unique in the output directory, so concurrent compiles of one file never share it
+    const char* name = strrchr(filepath, '/');
+    const uint32_t dir_length = name ? name + 1 - filepath : 0;
+    char temp_filepath[strlen(filepath) + 9];
+    memcpy(temp_filepath, filepath, dir_length);
+    sprintf(temp_filepath + dir_length, ".%s.XXXXXX", filepath + dir_length);
+
+    if(!caption_compile_layout(captions, flags, &layout, status))
     {
-        *error = 1;
-        goto caption_parse_success;
+        errno = status->system_error;
+        goto caption_compile_error;
+    }
+
+    const Header* header = &layout.header;
+    const uint64_t blocks_size = (uint64_t)header->block_count * BLOCK_SIZE;
+    start = compile_stats_stage(stats, StageLayout, start);
+
+    if(flags & Verbose)
+        u_fprintf(u_get_stdout(), "Writing VPK Header\nVCCD: %d\nVersion: %d\nBlock Count: %d\nBlock Size: %d\nDIR Size: %d\nData Offset: %d\n\n", header->vccd, header->version, header->block_count, header->block_size, header->dir_size, header->data_offset);
+
+    // The whole file in one zeroed buffer
+    data = (char*)calloc(layout.size, sizeof(char));
+    if(!data)
+        goto caption_compile_error;
+
+    if(!caption_compile_fill(captions, &layout, data, pool, flags, status))
+    {
+        errno = status->system_error;
+        goto caption_compile_error;
     }
+    start = compile_stats_stage(stats, StageFill, start);
+
+    if(flags & Verbose)
+        u_fprintf(u_get_stdout(), "Padding Dictionary with %d zeroes\n\nWriting caption strings of length %lu\n\n", header->data_offset - (HEADER_SIZE + header->dir_size * DIR_ENTRY_SIZE), blocks_size);
+
+    // Written next to the target and renamed over it, so a reader never sees a partial file
+    out_file = mkstemp(temp_filepath);
+    if(out_file < 0)
+        goto caption_compile_error;
+    temp_created = 1;
 
-    if(!extract_strings(caption, line, error))
-        goto caption_parse_error;
+    // mkstemp creates it readable by the owner only
+    if(fchmod(out_file, 0644) != 0)
+        goto caption_compile_error;
+
+    // Partial writes only happen on signals or full disks, pick up where the last one stopped
+    uint64_t written = 0;
+    while(written < layout.size)
+    {
+        const ssize_t n = write(out_file, data + written, layout.size - written);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            goto caption_compile_error;
+        }
+        if(n == 0)
+            break;
+
+        written += n;
+    }
 
-    if(!caption_hash(caption))
+    if(written != layout.size)
     {
-        *error = 1;
-        goto caption_parse_error;
+        errno = EIO;
+        goto caption_compile_error;
     }
 
-    goto caption_parse_success;
+    const int close_result = close(out_file);
+    out_file = -1;
+    if(close_result != 0 || rename(temp_filepath, filepath) != 0)
+        goto caption_compile_error;
 
-    caption_parse_error:
-        caption_destroy(&caption);
+    free(data);
+    compile_stats_stage(stats, StageWrite, start);
 
-    caption_parse_success:
+    // Read back through a fresh mapping rather than the buffer it was written from
+    if((flags & Verify) && !verify_output(captions, header, filepath, pool, flags, status))
+    {
+        caption_compile_release(&layout);
+        return 0;
+    }
+
+    uint64_t value_bytes = 0, shared_bytes = 0;
+    for(uint64_t i = 0; i < captions->size; ++i)
+    {
+        const uint64_t length_bytes = (captions->data[i].value_size + 1) * sizeof(UChar);
+        if(layout.shared && layout.shared[i] != i)
+            shared_bytes += length_bytes;
+        else
+            value_bytes += length_bytes;
+    }
+
+    if(stats)
+    {
+        ++stats->files;
+        stats->captions += captions->size;
+        stats->bytes_out += layout.size;
+        stats->blocks += header->block_count;
+        stats->padding_bytes += blocks_size - value_bytes;
+    }
+
+    if(flags & Dedup)
+        fprintf(stdout, "%s: Deduplicated %lu of %lu values, saving %lu bytes of value data\n", filepath, captions->size - layout.unique_count, captions->size, shared_bytes);
+
+    if(flags & Pack)
+    {
+        fprintf(stdout, "%s: Packed %lu values into %d blocks instead of %d, saving %ld bytes (padding %.2f%% of block data)\n",
+                filepath, layout.unique_count, header->block_count, layout.greedy_block_count, ((int64_t)layout.greedy_block_count - header->block_count) * BLOCK_SIZE,
+                100.0 * (blocks_size - value_bytes) / blocks_size);
+    }
+
+    caption_compile_release(&layout);
+
+    if(flags & Verbose)
+        u_fprintf(u_get_stdout(), "Successfully compiled to '%s'\n", filepath);
+
+    goto caption_compile_success;
+
+    caption_compile_error:
+    {
+        fprintf(stderr, "An error occured while writing to file '%s': %s\n", filepath, strerror(errno));
+        set_system_error(status, errno);
+
+        if(out_file >= 0)
+            close(out_file);
+        if(temp_created)
+            unlink(temp_filepath);
+
+        free(data);
+        caption_compile_release(&layout);
+
+        return 0;
+    }
+
+    caption_compile_success:
         ;
 
-    return caption;
+    return 1;
 }
 
-static CaptionList* read_captions(const char* filename, uint8_t flags)
+static int8_t has_extension(const char* filepath, const char* extension)
 {
-    UFILE* txt_file = NULL;
-    CaptionList* list = NULL;
-    
-    txt_file = u_fopen(filename, "r", NULL, "utf_16_le");
-    if(!txt_file)
-        goto caption_read_error;
+    const uint32_t length = strlen(filepath);
+    const uint32_t extension_length = strlen(extension);
+
+    return length >= extension_length && memcmp(filepath + (length - extension_length), extension, extension_length) == 0;
+}
+
+// Source path with .txt swapped for extension, released with free
+static char* replace_extension(const char* filepath, const char* extension)
+{
+    const uint32_t stem_length = strlen(filepath) - 4;
+    const uint32_t extension_length = strlen(extension);
+
+    char* result = (char*)malloc(stem_length + extension_length + 1);
+    if(result)
+    {
+        memcpy(result, filepath, stem_length);
+        memcpy(result + stem_length, extension, extension_length + 1);
+    }
+
+    return result;
+}
+
+// Everything besides the source that changes the bytes of the .dat
+static uint32_t build_options(DuplicatePolicy policy, uint8_t flags)
+{
+    return (flags & (Pack | Dedup)) | ((uint32_t)policy << 8);
+}
 
-    list = caption_list_init();
-    if(!list)
-        goto caption_read_error;
+// With caching, opens the source and checks it against the last build. Returns 1 if the output can be kept as is.
+static int8_t check_cache(const char* src_filepath, const char* out_filepath, const char* cache_filepath, SourceFile** source, CaptionCache** cache, uint64_t* source_fingerprint, DuplicatePolicy policy, uint8_t flags)
+{
+    if(!(flags & Cache))
+        return 0;
+
+    *source = source_file_init(src_filepath);
+    if(!*source)
+        return 0;
+
+    // Taken before parsing, which rewrites the mapping in place
+    *source_fingerprint = fingerprint64((*source)->data, (*source)->size * sizeof(UChar));
+    *cache = caption_cache_load(cache_filepath);
+    if(!caption_cache_fresh(*cache, build_options(policy, flags), (*source)->size, *source_fingerprint, out_filepath))
+        return 0;
+
+    if(flags & Verbose)
+        u_fprintf(u_get_stdout(), "'%s' is up to date\n", out_filepath);
 
-    uint32_t line_count = 0;
-    int8_t error = 0;
+    return 1;
+}
 
-    u_fgetc(txt_file);
+static void save_cache(const char* cache_filepath, const char* out_filepath, const SourceFile* source, const CaptionTable* table, const uint64_t source_fingerprint, DuplicatePolicy policy, uint8_t flags)
+{
+    if(!(flags & Cache))
+        return;
 
-    while(!u_feof(txt_file))
+    // Only costs the next build its shortcut
+    if(!caption_cache_save(cache_filepath, build_options(policy, flags), source->size, source_fingerprint, out_filepath, table))
+        fprintf(stderr, "Could not save build cache '%s': %s\n", cache_filepath, strerror(errno));
+}
+
+// state optionally carries the sort order of the previous build between calls, as watch mode does
+static int8_t compile_file(const char* src_filepath, ThreadPool* pool, CaptionCache** state, DuplicatePolicy policy, uint8_t flags, CompileStatus* status, CompileStats* stats)
+{
+    SourceFile* source = NULL;
+    CaptionTable* table = NULL;
+    CaptionCache* cache = NULL;
+    uint64_t source_fingerprint = 0;
+    int8_t compiled = 0;
+
+    memset(status, 0, sizeof(CompileStatus));
+
+    char* out_filepath = replace_extension(src_filepath, ".dat");
+    char* cache_filepath = replace_extension(src_filepath, ".captioncache");
+    if(!out_filepath || !cache_filepath)
+    {
+        set_system_error(status, errno);
+        print_read_error(src_filepath, status);
+        goto compile_file_end;
+    }
+
+    if(check_cache(src_filepath, out_filepath, cache_filepath, &source, &cache, &source_fingerprint, policy, flags))
+    {
+        compiled = 1;
+        goto compile_file_end;
+    }
+
+    table = read_captions(src_filepath, &source, pool, flags, status, stats);
+    if(!table || !finish_captions(src_filepath, table, pool, (state && *state) ? *state : cache, policy, flags, status, stats))
+        goto compile_file_end;
+
+    compiled = compile(table, out_filepath, pool, flags, status, stats);
+    if(compiled)
+        save_cache(cache_filepath, out_filepath, source, table, source_fingerprint, policy, flags);
+
+    if(compiled && state)
     {
-        ++line_count;
-        UString* line = ustring_getline(txt_file);
-        if(!line)
-            goto caption_read_error;
+        caption_cache_destroy(state);
+        *state = caption_cache_init(table);
+    }
+
+    compile_file_end:
+    {
+        if(table)
+            caption_table_destroy(&table);
+        if(source)
+            source_file_destroy(&source);
+        caption_cache_destroy(&cache);
+        free(out_filepath);
+        free(cache_filepath);
+    }
 
-        register UChar* data = line->data;
-        while(u_isspace(*data) && *data != '\0')
-            ++data;
+    return compiled;
+}
+
+static void read_language(void* data)
+{
+    LanguageTask* task = (LanguageTask*)data;
+    CaptionCache* cache = NULL;
+
+    task->up_to_date = check_cache(task->filename, task->out_filepath, task->cache_filepath, &task->source, &cache, &task->source_fingerprint, task->policy, task->flags);
+    caption_cache_destroy(&cache);
+    if(task->up_to_date)
+    {
+        source_file_destroy(&task->source);
+        return;
+    }
+
+    task->table = read_captions(task->filename, &task->source, task->pool, task->flags | SharedKeys, &task->status, task->stats);
+    task->failed = !task->table;
+}
+
+static void compile_language(void* data)
+{
+    LanguageTask* task = (LanguageTask*)data;
+    const uint8_t flags = task->flags | SharedKeys;
+    if(task->failed || task->up_to_date)
+        return;
+
+    task->failed = !finish_captions(task->filename, task->table, task->pool, NULL, task->policy, flags, &task->status, task->stats) ||
+                   !compile(task->table, task->out_filepath, task->pool, flags, &task->status, task->stats);
+    if(!task->failed)
+        save_cache(task->cache_filepath, task->out_filepath, task->source, task->table, task->source_fingerprint, task->policy, task->flags);
+}
+
+// Languages are read and compiled concurrently, one per task. In between every distinct key
+// is lowercased, hashed and sorted once for all of them.
+static int8_t compile_batch(char** filenames, const uint32_t file_count, ThreadPool* pool, DuplicatePolicy policy, uint8_t flags, CompileStats* stats)
+{
+    int8_t compiled = 0;
 
-        if(*data == '\"')
-            ++data;
+    // Languages run concurrently, so each one counts into its own stats until they're added up
+    LanguageTask* tasks = (LanguageTask*)calloc(file_count, sizeof(LanguageTask));
+    CaptionTable** tables = (CaptionTable**)malloc(file_count * sizeof(CaptionTable*));
+    CompileStats* language_stats = stats ? (CompileStats*)calloc(file_count, sizeof(CompileStats)) : NULL;
+    if(!tasks || !tables || (stats && !language_stats))
+    {
+        fprintf(stderr, "An error occured while reading %u files: %s\n", file_count, strerror(errno));
+        goto compile_batch_end;
+    }
 
-        if(u_strncmp(data, u"Tokens", 6) == 0)
+    for(uint32_t i = 0; i < file_count; ++i)
+    {
+        tasks[i] = (LanguageTask){filenames[i], replace_extension(filenames[i], ".dat"), replace_extension(filenames[i], ".captioncache"), NULL, NULL, pool, policy, 0, flags, {0}, stats ? &language_stats[i] : NULL, 0, 0};
+        if(!tasks[i].out_filepath || !tasks[i].cache_filepath)
         {
-            ustring_destroy(&line);
-            break;
+            fprintf(stderr, "An error occured while reading %u files: %s\n", file_count, strerror(errno));
+            goto compile_batch_end;
         }
-        ustring_destroy(&line);
     }
 
-    if(u_feof(txt_file))
+    // Verbose output has to stay in order, so languages take turns
+    if(flags & Verbose)
+    {
+        for(uint32_t i = 0; i < file_count; ++i)
+            thread_pool_run(pool, read_language, &tasks[i], sizeof(LanguageTask), 1);
+    }
+    else
+        thread_pool_run(pool, read_language, tasks, sizeof(LanguageTask), file_count);
+
+    // A language that failed to read doesn't stop the others
+    uint64_t entry_count = 0;
+    uint32_t table_count = 0, up_to_date_count = 0;
+    for(uint32_t i = 0; i < file_count; ++i)
     {
-        errno = ENODATA;
-        goto caption_read_error;
+        up_to_date_count += tasks[i].up_to_date;
+        if(tasks[i].failed || tasks[i].up_to_date)
+            continue;
+
+        tables[table_count++] = tasks[i].table;
+        entry_count += tasks[i].table->size;
     }
-    
-    while(!u_feof(txt_file))
+
+    const uint64_t start = compile_stats_start(stats);
+    const int64_t key_count = caption_intern_keys(tables, table_count, pool);
+    if(key_count < 0)
+    {
+        fprintf(stderr, "An error occured while hashing keys: %s\n", strerror(errno));
+        goto compile_batch_end;
+    }
+    compile_stats_stage(stats, StageHash, start);
+
+    if(flags & Verbose)
+        u_fprintf(u_get_stdout(), "Found %ld distinct keys among %lu entries in %u files\n\n", key_count, entry_count, table_count);
+
+    if(flags & Verbose)
     {
-        ++line_count;
-        UString* line = ustring_getline(txt_file);
-        if(!line)
-            goto caption_read_error;
+        for(uint32_t i = 0; i < file_count; ++i)
+            thread_pool_run(pool, compile_language, &tasks[i], sizeof(LanguageTask), 1);
+    }
+    else
+        thread_pool_run(pool, compile_language, tasks, sizeof(LanguageTask), file_count);
 
-        if(flags & Verbose)
-            u_fprintf(u_get_stdout(), "Parsing line \'%S\'\n", line->data);
-        
-        Caption* caption = parse_caption(line, &error);
-        ustring_destroy(&line);
+    compiled = table_count + up_to_date_count == file_count;
+    for(uint32_t i = 0; i < file_count; ++i)
+    {
+        if(tasks[i].failed)
+            compiled = 0;
+        if(stats)
+            compile_stats_add(stats, &language_stats[i]);
+    }
 
-        if(__builtin_expect(caption != NULL, 0))
-        {    
-            if(!caption_list_push(list, caption))
+    compile_batch_end:
+    {
+        if(tasks)
+        {
+            for(uint32_t i = 0; i < file_count; ++i)
             {
-                caption_destroy(&caption);
-                goto caption_read_error;
+                if(tasks[i].table)
+                    caption_table_destroy(&tasks[i].table);
+                if(tasks[i].source)
+                    source_file_destroy(&tasks[i].source);
+                free(tasks[i].out_filepath);
+                free(tasks[i].cache_filepath);
             }
         }
-        else if(error)
-            goto caption_read_error;
+
+        free(tasks);
+        free(tables);
+        free(language_stats);
     }
 
-    if(flags & Verbose)
-        u_fprintf(u_get_stdout(), "Found %lu entries\n\n", list->size);
+    return compiled;
+}
+
+// Adds path, or every .txt file directly inside it when it's a directory, in name order
+static int8_t add_input(char*** inputs, uint32_t* input_count, const char* path)
+{
+    struct dirent** entries = NULL;
+    int entry_count = 0;
+    int8_t added = 0;
+
+    struct stat st;
+    const int8_t is_directory = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+    if(is_directory)
+    {
+        entry_count = scandir(path, &entries, NULL, alphasort);
+        if(entry_count < 0)
+            return 0;
+    }
+
+    char** new_inputs = (char**)realloc(*inputs, (*input_count + (is_directory ? entry_count : 1)) * sizeof(char*));
+    if(!new_inputs)
+        goto add_input_end;
+    *inputs = new_inputs;
+
+    if(!is_directory)
+    {
+        new_inputs[(*input_count)++] = strdup(path);
+        return new_inputs[*input_count - 1] != NULL;
+    }
+
+    const uint32_t path_length = strlen(path);
+    for(int i = 0; i < entry_count; ++i)
+    {
+        const char* name = entries[i]->d_name;
+        const uint32_t name_length = strlen(name);
+        if(name_length < 4 || memcmp(name + (name_length - 4), ".txt", 4) != 0)
+            continue;
+
+        char* input = (char*)malloc(path_length + name_length + 2);
+        if(!input)
+            goto add_input_end;
+
+        memcpy(input, path, path_length);
+        input[path_length] = '/';
+        memcpy(input + path_length + 1, name, name_length + 1);
+        new_inputs[(*input_count)++] = input;
+    }
+    added = 1;
+
+    add_input_end:
+    {
+        for(int i = 0; i < entry_count; ++i)
+            free(entries[i]);
+        free(entries);
+    }
+
+    return added;
+}
+
+static double now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+// The signal number is only there for the handler signature
+static void request_stop(int signal_number)
+{
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+// Called before the thread pool starts, so its threads inherit a mask without SIGINT and SIGTERM
+// and the signals can only reach the thread that unblocks them in catch_stop_signals
+static void block_stop_signals(void)
+{
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+}
+
+// No SA_RESTART, so a signal gets the calling thread out of whatever call it is blocked in
+static void catch_stop_signals(void)
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+}
+
+// Compiles every input, then recompiles each one again whenever it changes on disk, until interrupted
+static int8_t watch_files(char** filenames, const uint32_t file_count, ThreadPool* pool, DuplicatePolicy policy, uint8_t flags)
+{
+    char buffer[WATCH_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    CompileStatus status;
+    int8_t watched = 0;
+    WatchedFile* files = (WatchedFile*)calloc(file_count, sizeof(WatchedFile));
+    const int fd = inotify_init1(IN_CLOEXEC);
+    if(!files || fd < 0)
+        goto watch_files_end;
+
+    for(uint32_t i = 0; i < file_count; ++i)
+    {
+        WatchedFile* file = &files[i];
+        const char* slash = strrchr(filenames[i], '/');
+        const uint32_t directory_length = slash ? ((slash == filenames[i]) ? 1 : slash - filenames[i]) : 1;
+
+        char directory[directory_length + 1];
+        memcpy(directory, slash ? filenames[i] : ".", directory_length);
+        directory[directory_length] = '\0';
+
+        // Editors often save by writing a new file and renaming it over the old one, so the directory is watched
+        file->filepath = filenames[i];
+        file->name = slash ? slash + 1 : filenames[i];
+        file->directory = inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE);
+        if(file->directory < 0)
+            goto watch_files_end;
+
+        compile_file(file->filepath, pool, &file->state, policy, flags, &status, NULL);
+    }
+
+    // A rebuild under way is finished before the signal is seen, so no temporary file is left behind
+    catch_stop_signals();
 
-    caption_list_sort(list);
-    u_fclose(txt_file);
-    goto caption_read_success;
+    fprintf(stdout, "Watching %u file(s) for changes\n", file_count);
+    fflush(stdout);
 
-    caption_read_error:
+    while(!stop_requested)
     {
-        switch(errno) 
+        // Sleep until a change arrives or the oldest pending one has been quiet long enough
+        int timeout = -1;
+        const double now = now_ms();
+        for(uint32_t i = 0; i < file_count; ++i)
         {
-            case EOVERFLOW:
-                fprintf(stderr, "An error occured while reading file '%s': Value at line %u exceeds maximum length of %u\n", filename, line_count, (BLOCK_SIZE >> 1) - 1);
-                break;
-            case ENODATA:
-                fprintf(stderr, "An error occured while reading file '%s': Could not find token declaration\n", filename);
-                break;
-            case EINVAL:
-                fprintf(stderr, "An error occured while reading file '%s': Line %u has a key of length 0\n", filename, line_count);
-                break;
-            default:
-                fprintf(stderr, "An error occured while reading file '%s': %s\n", filename, strerror(errno));
-                break;
+            if(!files[i].pending)
+                continue;
+
+            const double remaining = files[i].changed_at + WATCH_DEBOUNCE_MS - now;
+            const int wait = (remaining > 0) ? (int)remaining + 1 : 0;
+            if(timeout < 0 || wait < timeout)
+                timeout = wait;
+        }
+
+        struct pollfd watch_fd = {fd, POLLIN, 0};
+        const int ready = poll(&watch_fd, 1, timeout);
+        if(ready < 0 && errno != EINTR)
+            goto watch_files_end;
+
+        if(ready > 0)
+        {
+            const ssize_t length = read(fd, buffer, sizeof(buffer));
+            if(length < 0 && errno != EINTR)
+                goto watch_files_end;
+
+            // Every write pushes the rebuild back, so a save made of several writes gives one rebuild
+            const double event_time = now_ms();
+            for(ssize_t offset = 0; offset < length;)
+            {
+                const struct inotify_event* event = (const struct inotify_event*)(buffer + offset);
+                offset += sizeof(struct inotify_event) + event->len;
+
+                for(uint32_t i = 0; i < file_count; ++i)
+                {
+                    if((event->mask & IN_Q_OVERFLOW) || (event->len && files[i].directory == event->wd && strcmp(files[i].name, event->name) == 0))
+                    {
+                        files[i].pending = 1;
+                        files[i].changed_at = event_time;
+                    }
+                }
+            }
         }
 
-        if(txt_file)
-            u_fclose(txt_file);
-        if(list)
-            caption_list_destroy(&list);
+        const double rebuild_time = now_ms();
+        for(uint32_t i = 0; i < file_count; ++i)
+        {
+            WatchedFile* file = &files[i];
+            if(!file->pending || rebuild_time - file->changed_at < WATCH_DEBOUNCE_MS)
+                continue;
+
+            file->pending = 0;
+            const double start = now_ms();
+            if(compile_file(file->filepath, pool, &file->state, policy, flags, &status, NULL))
+            {
+                const double end = now_ms();
+                fprintf(stdout, "Rebuilt '%s' in %.1f ms, %.1f ms after the last change\n", file->filepath, end - start, end - file->changed_at);
+            }
+            fflush(stdout);
+        }
     }
+    watched = 1;
 
-    caption_read_success:
-        ;
+    watch_files_end:
+    {
+        if(!watched)
+            fprintf(stderr, "Could not watch files: %s\n", strerror(errno));
 
-    return list;
-};
+        if(files)
+        {
+            for(uint32_t i = 0; i < file_count; ++i)
+                caption_cache_destroy(&files[i].state);
+        }
+        if(fd >= 0)
+            close(fd);
+        free(files);
+    }
 
-static int8_t compile(CaptionList* captions, const char* filepath, uint8_t flags)
+    return watched;
+}
+
+
+// Reads exactly size bytes, 0 on end of stream, error or when a signal asked to stop
+static int8_t read_all(const int fd, void* data, const size_t size)
 {
-    FILE* out_file = NULL;
-    Buffer* caption_buffer = NULL;
-    
-    out_file = fopen(filepath, "wb");
-    if(!out_file)
-        goto caption_compile_error;
+    size_t done = 0;
+    while(done < size)
+    {
+        const ssize_t n = read(fd, (char*)data + done, size - done);
+        if(n < 0 && errno == EINTR && !stop_requested)
+            continue;
+        if(n <= 0)
+            return 0;
 
-    int32_t dict_padding = 512 - ((HEADER_SIZE + captions->size * DIR_ENTRY_SIZE) % 512);
-    
-    Header header;
-    header.vccd = VCCD;
-    header.version = VERSION;
-    header.block_count = 0; // Write later
-    header.block_size = BLOCK_SIZE;
-    header.dir_size = captions->size;
-    header.data_offset = HEADER_SIZE + captions->size * DIR_ENTRY_SIZE + dict_padding;
-    
-    if(flags & Verbose)
-        u_fprintf(u_get_stdout(), "Writing VPK Header\nVCCD: %d\nVersion: %d\nBlock Count: %d\nBlock Size: %d\nDIR Size: %d\nData Offset: %d\n\n", header.vccd, header.version, header.block_count, header.block_size, header.dir_size, header.data_offset);
-    
-    fwrite(&header, HEADER_SIZE, 1, out_file);
+        done += n;
+    }
 
-    caption_buffer = buffer_init(INITIAL_BUFFER_SIZE * sizeof(UChar));
-    if(!caption_buffer)
-        goto caption_compile_error;
+    return 1;
+}
 
-    uint32_t expected_buffer_size = 0;
-    int16_t current_offset = 0;
+// A peer that hung up gives an error instead of SIGPIPE
+static int8_t send_all(const int fd, const void* data, const size_t size)
+{
+    size_t done = 0;
+    while(done < size)
+    {
+        const ssize_t n = send(fd, (const char*)data + done, size - done, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR && !stop_requested)
+            continue;
+        if(n <= 0)
+            return 0;
+
+        done += n;
+    }
 
-    while(captions->size != 0)
+    return 1;
+}
+
+// Compiles one requested file, keeping the sort order of its last build for the next request
+static void serve_request(ServedFile** files, uint32_t* file_count, const ServeRequest* request, const char* filepath, ThreadPool* pool, ServeReply* reply)
+{
+    CompileStatus status;
+    ServedFile* file = NULL;
+
+    memset(reply, 0, sizeof(ServeReply));
+    reply->magic = SERVE_MAGIC;
+    reply->error = CompileSystemError;
+
+    if(!has_extension(filepath, ".txt") || request->policy > DuplicateLast)
     {
-        Caption* caption = caption_list_pop(captions);
-        const int16_t length_bytes = (caption->value->size + 1) * sizeof(UChar);
-        
-        if(current_offset + length_bytes > BLOCK_SIZE)
+        reply->system_error = EINVAL;
+        return;
+    }
+
+    for(uint32_t i = 0; i < *file_count && !file; ++i)
+    {
+        if(strcmp((*files)[i].filepath, filepath) == 0)
+            file = &(*files)[i];
+    }
+
+    if(!file)
+    {
+        ServedFile* new_files = (ServedFile*)realloc(*files, (*file_count + 1) * sizeof(ServedFile));
+        if(!new_files)
         {
-            int32_t leftover = BLOCK_SIZE - current_offset;
-            buffer_dup(caption_buffer, 0, leftover);
+            reply->system_error = errno;
+            return;
+        }
+        *files = new_files;
 
-            ++header.block_count;
-            expected_buffer_size += leftover;
-            current_offset = 0;
+        file = &new_files[*file_count];
+        file->filepath = strdup(filepath);
+        file->state = NULL;
+        if(!file->filepath)
+        {
+            reply->system_error = errno;
+            return;
         }
+        ++*file_count;
+    }
 
-        if(flags & Verbose)
-            u_fprintf(u_get_stdout(), "Writing Caption data for \'%S\'\nHash: %u\nBlock: %d\nOffset: %hd\nLength: %hd\n\n", caption->value->data, caption->hash, header.block_count, current_offset, length_bytes);
-        
-        // Directory entry
-        fwrite(&caption->hash, sizeof(uint32_t), 1, out_file);
-        fwrite(&header.block_count, sizeof(int32_t), 1, out_file);
-        fwrite(&current_offset, sizeof(int16_t), 1, out_file);
-        fwrite(&length_bytes, sizeof(int16_t), 1, out_file);
-        
-        // Append buffer together with '\0'
-        buffer_append(caption_buffer, caption->value->data, length_bytes);
+    const double start = now_ms();
+    const int8_t compiled = compile_file(file->filepath, pool, &file->state, (DuplicatePolicy)request->policy, request->flags & (Pack | Dedup | Cache | Verify), &status, NULL);
+    reply->milliseconds = now_ms() - start;
 
-        expected_buffer_size += length_bytes;
-        current_offset += length_bytes;
-        caption_destroy(&caption);
+    reply->error = status.code;
+    reply->system_error = status.system_error;
+    reply->line = (status.code == CompileDuplicateKey || status.code == CompileHashCollision) ? status.conflict.second.line : status.line;
+    if(!compiled)
+        return;
+
+    // Whether it was just written or already up to date, the .dat describes itself
+    Header header;
+    struct stat st;
+    char* out_filepath = replace_extension(file->filepath, ".dat");
+    const int out_file = out_filepath ? open(out_filepath, O_RDONLY) : -1;
+    if(out_file >= 0 && read_all(out_file, &header, sizeof(Header)) && fstat(out_file, &st) == 0)
+    {
+        reply->entry_count = header.dir_size;
+        reply->block_count = header.block_count;
+        reply->output_size = st.st_size;
     }
 
-    int32_t leftover = BLOCK_SIZE - current_offset;
-    buffer_dup(caption_buffer, 0, leftover);
-    expected_buffer_size += leftover;
+    if(out_file >= 0)
+        close(out_file);
+    free(out_filepath);
+}
 
-    if(flags & Verbose)
-        u_fprintf(u_get_stdout(), "Padding Dictionary with %d zeroes\n\n", dict_padding);
+// Answers compile requests on a Unix domain socket until interrupted. ICU, the thread pool and the
+// sort order of every language compiled so far stay loaded between requests.
+static int8_t serve(const char* socket_path, ThreadPool* pool)
+{
+    ServedFile* files = NULL;
+    uint32_t file_count = 0;
+    int8_t served = 0;
+    int listener = -1;
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(strlen(socket_path) >= sizeof(address.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        goto serve_end;
+    }
+    strcpy(address.sun_path, socket_path);
 
-    // Pad dictionary with 0
-    while(--dict_padding >= 0)
-        fputc(0, out_file);
+    listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(listener < 0)
+        goto serve_end;
 
-    if(flags & Verbose)
-        u_fprintf(u_get_stdout(), "Writing caption strings of length %u\n", caption_buffer->size);
+    // Left behind by a server that didn't get to clean up
+    struct stat st;
+    if(stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(socket_path);
 
-    // Write caption buffer
-    fwrite(caption_buffer->data, sizeof(char), caption_buffer->size, out_file);
-    buffer_destroy(&caption_buffer);
+    if(bind(listener, (const struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, SERVE_BACKLOG) != 0)
+        goto serve_end;
 
-    if(ftell(out_file) != expected_buffer_size + header.data_offset)
+    catch_stop_signals();
+
+    fprintf(stdout, "Serving on '%s'\n", socket_path);
+    fflush(stdout);
+
+    while(!stop_requested)
     {
-        errno = EIO;
-        goto caption_compile_error;
+        const int connection = accept(listener, NULL, NULL);
+        if(connection < 0)
+        {
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+            goto serve_end;
+        }
+
+        // Requests on one connection are answered in order until the client hangs up
+        ServeRequest request;
+        while(!stop_requested && read_all(connection, &request, sizeof(ServeRequest)))
+        {
+            if(request.magic != SERVE_MAGIC || request.path_length == 0 || request.path_length > PATH_MAX)
+                break;
+
+            char filepath[request.path_length + 1];
+            if(!read_all(connection, filepath, request.path_length))
+                break;
+            filepath[request.path_length] = '\0';
+
+            ServeReply reply;
+            serve_request(&files, &file_count, &request, filepath, pool, &reply);
+            fflush(stdout);
+
+            if(!send_all(connection, &reply, sizeof(ServeReply)))
+                break;
+        }
+
+        close(connection);
     }
-    
-    // Go back to header and write the number of blocks
-    ++header.block_count;
+    served = 1;
 
-    if(flags & Verbose)
-        u_fprintf(u_get_stdout(), "Updating Block Size from 0 to %d\n\n", header.block_count);
+    serve_end:
+    {
+        if(!served)
+            fprintf(stderr, "Could not serve on '%s': %s\n", socket_path, strerror(errno));
 
-    fseek(out_file, 2 * sizeof(int32_t), SEEK_SET);
-    fwrite(&header.block_count, sizeof(int32_t), 1, out_file);
-    
-    fclose(out_file);
+        if(listener >= 0)
+        {
+            close(listener);
+            if(served)
+                unlink(socket_path);
+        }
 
-    if(flags & Verbose)
-        u_fprintf(u_get_stdout(), "Successfully compiled to '%s'\n", filepath);
+        for(uint32_t i = 0; i < file_count; ++i)
+        {
+            free(files[i].filepath);
+            caption_cache_destroy(&files[i].state);
+        }
+        free(files);
+    }
 
-    goto caption_compile_success;
+    return served;
+}
 
-    caption_compile_error:
+// Has a server started with --serve compile each file, in order
+static int8_t send_to_server(const char* socket_path, char** filenames, const uint32_t file_count, DuplicatePolicy policy, uint8_t flags)
+{
+    int8_t compiled = 1;
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if(strlen(socket_path) >= sizeof(address.sun_path))
     {
-        fprintf(stderr, "An error occured while writing to file '%s': %s\n", filepath, strerror(errno));
+        fprintf(stderr, "Could not connect to '%s': %s\n", socket_path, strerror(ENAMETOOLONG));
+        return 0;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    const int connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(connection < 0 || connect(connection, (const struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        fprintf(stderr, "Could not connect to '%s': %s\n", socket_path, strerror(errno));
+        if(connection >= 0)
+            close(connection);
+        return 0;
+    }
+
+    for(uint32_t i = 0; i < file_count; ++i)
+    {
+        // The server may run somewhere else in the file system
+        char* filepath = realpath(filenames[i], NULL);
+        if(!filepath)
+        {
+            fprintf(stderr, "An error occured while reading file '%s': %s\n", filenames[i], strerror(errno));
+            compiled = 0;
+            continue;
+        }
+
+        ServeRequest request = {SERVE_MAGIC, flags & (Pack | Dedup | Cache | Verify), policy, strlen(filepath)};
+        ServeReply reply;
+        const int8_t answered = send_all(connection, &request, sizeof(ServeRequest)) && send_all(connection, filepath, request.path_length) &&
+                                read_all(connection, &reply, sizeof(ServeReply)) && reply.magic == SERVE_MAGIC;
+        free(filepath);
+
+        if(!answered)
+        {
+            fprintf(stderr, "Lost the connection to '%s'\n", socket_path);
+            compiled = 0;
+            break;
+        }
+
+        if(reply.error == CompileOk)
+            fprintf(stdout, "%s: %u entries in %u blocks, %lu bytes, compiled%s in %.1f ms\n", filenames[i], reply.entry_count, reply.block_count, reply.output_size, (flags & Verify) ? " and verified" : "", reply.milliseconds);
+        else
+        {
+            const char* message = (reply.error == CompileSystemError) ? strerror(reply.system_error) : caption_compile_error_string(reply.error);
+            if(reply.line)
+                fprintf(stderr, "An error occured while compiling file '%s': %s at line %u\n", filenames[i], message, reply.line);
+            else
+                fprintf(stderr, "An error occured while compiling file '%s': %s\n", filenames[i], message);
+            compiled = 0;
+        }
+    }
+
+    close(connection);
 
-        if(out_file)
-            fclose(out_file);
-        if(caption_buffer)
-            buffer_destroy(&caption_buffer);
-        if(captions)
-            caption_list_empty(captions);
+    return compiled;
+}
+
+// Prints every entry of a .dat as source text, with the keys of the file it was compiled from if there is one
+static int8_t decompile_file(const char* dat_filepath, const char* src_filepath, ThreadPool* pool)
+{
+    CompileStatus status;
+    SourceFile* source = NULL;
+    CaptionTable* keys = NULL;
+    int8_t decompiled = 0;
 
+    DatFile* file = dat_file_open(dat_filepath);
+    if(!file)
+    {
+        fprintf(stderr, "An error occured while reading file '%s': %s\n", dat_filepath, (errno == EBADMSG) ? "Not a valid closed caption file" : strerror(errno));
         return 0;
     }
 
-    caption_compile_success:
-        ;
+    if(src_filepath)
+    {
+        keys = read_captions(src_filepath, &source, pool, 0, &status, NULL);
+        if(!keys)
+            goto decompile_file_end;
+    }
 
-    return 1;
+    fflush(stdout);
+    const int64_t bad_count = dat_file_decompile(file, keys, STDOUT_FILENO, pool);
+    if(bad_count < 0)
+        fprintf(stderr, "An error occured while decompiling file '%s': %s\n", dat_filepath, strerror(errno));
+    else if(bad_count > 0)
+        fprintf(stderr, "An error occured while decompiling file '%s': %ld values are out of bounds or not terminated\n", dat_filepath, bad_count);
+
+    decompiled = bad_count == 0;
+
+    decompile_file_end:
+    {
+        if(keys)
+            caption_table_destroy(&keys);
+        if(source)
+            source_file_destroy(&source);
+        dat_file_destroy(&file);
+    }
+
+    return decompiled;
 }
 
+static void print_change(const char* name, const uint64_t old_value, const uint64_t new_value)
+{
+    printf("%-18s %lu -> %lu (%+ld)\n", name, old_value, new_value, (int64_t)(new_value - old_value));
+}
 
-int main(int argc, char** argv)
+// Lists the entries that differ between two compiled files, with keys from up to two sources, and sums up their blocks
+static int8_t diff_files(const char* old_filepath, const char* new_filepath, char** src_filepaths, const uint32_t src_count, ThreadPool* pool)
 {
-    const char help_message[] = "Usage: ./Main [source].txt\n\
-        \nExample: ./Main closecaption_english.txt";
+    CompileStatus status;
+    SourceFile* sources[2] = {NULL, NULL};
+    CaptionTable* keys = NULL;
+    int8_t diffed = 0;
 
-    const char* src_filepath = "";
+    DatFile* files[2] = {dat_file_open(old_filepath), dat_file_open(new_filepath)};
+    for(uint32_t i = 0; i < 2; ++i)
+    {
+        if(!files[i])
+        {
+            fprintf(stderr, "An error occured while reading file '%s': %s\n", i ? new_filepath : old_filepath,
+                    (errno == EBADMSG) ? "Not a valid closed caption file" : strerror(errno));
+            goto diff_files_end;
+        }
+    }
+
+    for(uint32_t i = 0; i < src_count; ++i)
+    {
+        CaptionTable* table = read_captions(src_filepaths[i], &sources[i], pool, 0, &status, NULL);
+        if(!table)
+            goto diff_files_end;
+
+        if(!keys)
+            keys = table;
+        else
+        {
+            const int8_t appended = caption_table_append(keys, table) != NULL;
+            caption_table_destroy(&table);
+            if(!appended)
+            {
+                fprintf(stderr, "An error occured while reading file '%s': %s\n", src_filepaths[i], strerror(errno));
+                goto diff_files_end;
+            }
+        }
+    }
+
+    DatDiff diff;
+    fflush(stdout);
+    if(dat_file_diff(files[0], files[1], keys, STDOUT_FILENO, pool, &diff) < 0)
+    {
+        fprintf(stderr, "An error occured while comparing '%s' and '%s': %s\n", old_filepath, new_filepath, strerror(errno));
+        goto diff_files_end;
+    }
+
+    const DatUsage* old_usage = &diff.usage[0];
+    const DatUsage* new_usage = &diff.usage[1];
+    printf("\n%lu added, %lu removed, %lu changed, %lu moved to another block, %lu moved inside their block\n",
+           diff.added, diff.removed, diff.changed, diff.moved, diff.shifted);
+    print_change("Entries:", old_usage->entry_count, new_usage->entry_count);
+    print_change("Blocks:", old_usage->block_count, new_usage->block_count);
+    print_change("Value bytes:", old_usage->value_bytes, new_usage->value_bytes);
+    print_change("Used bytes:", old_usage->used_bytes, new_usage->used_bytes);
+    print_change("Padding bytes:", old_usage->padding_bytes, new_usage->padding_bytes);
+    print_change("Directory padding:", old_usage->header_padding, new_usage->header_padding);
+    print_change("File size:", files[0]->size, files[1]->size);
+
+    if(diff.blocks_changed)
+        printf("%d of the blocks in both files end elsewhere, the first is block %d\n", diff.blocks_changed, diff.first_block_changed);
+    else
+        printf("Every block in both files ends in the same place\n");
+
+    fflush(stdout);
+    if(diff.invalid)
+        fprintf(stderr, "%lu entries have values that are out of bounds or not terminated\n", diff.invalid);
+
+    diffed = 1;
+
+    diff_files_end:
+    {
+        if(keys)
+            caption_table_destroy(&keys);
+        for(uint32_t i = 0; i < 2; ++i)
+        {
+            if(sources[i])
+                source_file_destroy(&sources[i]);
+            if(files[i])
+                dat_file_destroy(&files[i]);
+        }
+    }
+
+    return diffed;
+}
+
+
+int main(int argc, char** argv)
+{
+    const char help_message[] = "Usage: ./Main [options] [source].txt...\n\
+        \nOptions:\n\
+        -v      Verbose output\n\
+        -j N    Parse and compile with N threads (default 1)\n\
+        -d P    What to do with duplicate keys: error, first or last (default)\n\
+        --pack  Pack values into as few blocks as possible instead of key order\n\
+        --dedup Store identical values once and share them between keys\n\
+        --cache Keep a .captioncache next to each .dat and skip rebuilding unchanged sources\n\
+        --watch Stay running and recompile each file as soon as it changes\n\
+        --verify Read each written file back and check it against the source\n\
+        --serve S  Keep running and compile the files asked for on the Unix domain socket S\n\
+        --client S Have the server on socket S compile the files instead\n\
+        --decompile F.dat [F.txt] Print the entries of F.dat as UTF-8 source text, with keys from F.txt if given\n\
+        --diff A.dat B.dat [A.txt] [B.txt] List the entries added, removed, changed or moved from A.dat to B.dat and compare their blocks\n\
+        --stats[=json] Print the time of every stage, counts of what was read and written, allocations and peak memory\n\
+        \nSeveral files, or directories of them, are compiled together and share the work on their keys.\n\
+        \nExample: ./Main -j 4 closecaption_english.txt\n\
+         ./Main -j 8 resource/closecaption_*.txt";
+
+    char** inputs = NULL;
+    uint32_t input_count = 0;
     uint8_t flags = 0;
+    uint32_t thread_count = 1;
+    DuplicatePolicy policy = DuplicateLast;
+    RunMode mode = ModeCompile;
+    StatsOutput stats_output = StatsOff;
+    const char* socket_path = NULL;
 
     ParserErrorData error_data = {ArgCount, ""};
     int i = 1;
@@ -399,12 +1356,59 @@ int main(int argc, char** argv)
     {
         if(argv[i][0] != '-')
         {
-            if(i == argc - 1)
+            if(!add_input(&inputs, &input_count, argv[i]))
+            {
+                error_data = (ParserErrorData){InvalidArg, argv[i]};
+                goto PARSER_ERROR;
+            }
+
+            ++i;
+            continue;
+        }
+
+        if(argv[i][1] == '-')
+        {
+            if(strcmp(argv[i], "--pack") == 0)
+                flags |= Pack;
+            else if(strcmp(argv[i], "--dedup") == 0)
+                flags |= Dedup;
+            else if(strcmp(argv[i], "--cache") == 0)
+                flags |= Cache;
+            else if(strcmp(argv[i], "--watch") == 0)
+                flags |= Watch;
+            else if(strcmp(argv[i], "--verify") == 0)
+                flags |= Verify;
+            else if(strcmp(argv[i], "--decompile") == 0)
+                mode = ModeDecompile;
+            else if(strcmp(argv[i], "--diff") == 0)
+                mode = ModeDiff;
+            else if(strcmp(argv[i], "--stats") == 0)
+                stats_output = StatsTable;
+            else if(strcmp(argv[i], "--stats=json") == 0)
+                stats_output = StatsJson;
+            else if(strcmp(argv[i], "--serve") == 0 || strcmp(argv[i], "--client") == 0)
             {
-                src_filepath = argv[i];
-                goto VALID_ARGS;
+                if(i + 1 >= argc)
+                {
+                    error_data = (ParserErrorData){MissingArg, argv[i]};
+                    goto PARSER_ERROR;
+                }
+
+                mode = (argv[i][2] == 's') ? ModeServe : ModeClient;
+                socket_path = argv[++i];
+            }
+            else
+            {
+                error_data = (ParserErrorData){InvalidArg, argv[i]};
+                goto PARSER_ERROR;
             }
 
+            ++i;
+            continue;
+        }
+
+        if(argv[i][1] != '\0' && argv[i][2] != '\0')
+        {
             error_data = (ParserErrorData){InvalidArg, argv[i]};
             goto PARSER_ERROR;
         }
@@ -421,12 +1425,47 @@ int main(int argc, char** argv)
             case 'v':
                 flags |= Verbose;
                 break;
-        }
-
-        if(argv[i][2] != '\0')
-        {
-            error_data = (ParserErrorData){InvalidArg, argv[i]};
-            goto PARSER_ERROR;
+            case 'j':
+            {
+                if(i + 1 >= argc)
+                {
+                    error_data = (ParserErrorData){MissingArg, argv[i]};
+                    goto PARSER_ERROR;
+                }
+
+                char* end = NULL;
+                const unsigned long count = strtoul(argv[++i], &end, 10);
+                if(*end != '\0' || count == 0 || count > MAX_THREADS)
+                {
+                    error_data = (ParserErrorData){InvalidArg, argv[i]};
+                    goto PARSER_ERROR;
+                }
+
+                thread_count = count;
+                break;
+            }
+            case 'd':
+            {
+                if(i + 1 >= argc)
+                {
+                    error_data = (ParserErrorData){MissingArg, argv[i]};
+                    goto PARSER_ERROR;
+                }
+
+                ++i;
+                if(strcmp(argv[i], "error") == 0)
+                    policy = DuplicateError;
+                else if(strcmp(argv[i], "first") == 0)
+                    policy = DuplicateFirst;
+                else if(strcmp(argv[i], "last") == 0)
+                    policy = DuplicateLast;
+                else
+                {
+                    error_data = (ParserErrorData){InvalidArg, argv[i]};
+                    goto PARSER_ERROR;
+                }
+                break;
+            }
         }
 
         ++i;
@@ -461,29 +1500,123 @@ int main(int argc, char** argv)
 
     VALID_ARGS:
     {
-        const uint32_t src_length = strlen(src_filepath);
-        if(src_length < 4 || memcmp(src_filepath + (src_length - 4), ".txt", 4) != 0)
+        if(stats_output != StatsOff && (mode != ModeCompile || (flags & Watch)))
         {
-            fprintf(stderr, "Only .txt files are accepted.\n");
+            fprintf(stderr, "Stats are only kept for compiling files once.\n");
             return -1;
         }
 
-        char out_filepath[src_length + 1];
-        memcpy(out_filepath, src_filepath, src_length - 4);
-        memcpy(out_filepath + (src_length - 4), ".dat", 5);
-
+        if(mode == ModeDecompile)
+        {
+            if(input_count < 1 || input_count > 2 || !has_extension(inputs[0], ".dat") || (input_count == 2 && !has_extension(inputs[1], ".txt")))
+            {
+                fprintf(stderr, "Decompiling takes a .dat file and optionally the .txt file it was compiled from.\n");
+                return -1;
+            }
+        }
+        else if(mode == ModeDiff)
+        {
+            int8_t valid = input_count >= 2 && input_count <= 4 && has_extension(inputs[0], ".dat") && has_extension(inputs[1], ".dat");
+            for(uint32_t j = 2; j < input_count; ++j)
+                valid = valid && has_extension(inputs[j], ".txt");
 
-        CaptionList* list = read_captions(src_filepath, flags);
-        if(!list)
+            if(!valid)
+            {
+                fprintf(stderr, "Comparing takes two .dat files and optionally the .txt files they were compiled from.\n");
+                return -1;
+            }
+        }
+        else if((mode == ModeServe || mode == ModeClient) && (flags & Watch))
+        {
+            fprintf(stderr, "Watching recompiles files in this process, it can't be used with --serve or --client.\n");
             return -1;
+        }
+        else if(mode == ModeServe)
+        {
+            if(input_count > 0)
+            {
+                fprintf(stderr, "The server compiles the files its clients ask for, give them to --client instead.\n");
+                return -1;
+            }
+        }
+        else
+        {
+            if(mode == ModeClient && (flags & Verbose))
+            {
+                fprintf(stderr, "Verbose output would be printed by the server, it can't be used with --client.\n");
+                return -1;
+            }
+
+            if(input_count == 0)
+            {
+                fprintf(stderr, "Only .txt files are accepted.\n");
+                return -1;
+            }
 
-        if(!compile(list, out_filepath, flags))
+            for(uint32_t j = 0; j < input_count; ++j)
+            {
+                if(!has_extension(inputs[j], ".txt"))
+                {
+                    fprintf(stderr, "Only .txt files are accepted.\n");
+                    return -1;
+                }
+            }
+        }
+
+        if(mode == ModeServe || (flags & Watch))
+            block_stop_signals();
+
+        ThreadPool* pool = thread_pool_init(thread_count);
+        if(!pool)
         {
-            caption_list_destroy(&list);
+            fprintf(stderr, "Could not start %u threads: %s\n", thread_count, strerror(errno));
             return -1;
         }
 
-        caption_list_destroy(&list);
+        CompileStats stats = {0};
+        CompileStats* run_stats = (stats_output != StatsOff) ? &stats : NULL;
+        count_allocations = run_stats != NULL;
+        const uint64_t start = compile_stats_start(run_stats);
+
+        int8_t compiled;
+        if(mode == ModeDecompile)
+            compiled = decompile_file(inputs[0], (input_count == 2) ? inputs[1] : NULL, pool);
+        else if(mode == ModeDiff)
+            compiled = diff_files(inputs[0], inputs[1], inputs + 2, input_count - 2, pool);
+        else if(mode == ModeServe)
+            compiled = serve(socket_path, pool);
+        else if(mode == ModeClient)
+            compiled = send_to_server(socket_path, inputs, input_count, policy, flags);
+        else if(flags & Watch)
+            compiled = watch_files(inputs, input_count, pool, policy, flags);
+        else if(input_count == 1)
+        {
+            CompileStatus status;
+            compiled = compile_file(inputs[0], pool, NULL, policy, flags, &status, run_stats);
+        }
+        else
+            compiled = compile_batch(inputs, input_count, pool, policy, flags, run_stats);
+
+        if(run_stats)
+        {
+            stats.total_ns = compile_stats_clock() - start;
+            stats.allocations = allocation_count;
+            stats.reallocations = reallocation_count;
+            compile_stats_sample_memory(&stats);
+
+            if(stats_output == StatsJson)
+                compile_stats_print_json(&stats, stdout);
+            else
+                compile_stats_print(&stats, stdout);
+        }
+
+        thread_pool_destroy(&pool);
+        for(uint32_t j = 0; j < input_count; ++j)
+            free(inputs[j]);
+        free(inputs);
+
+        if(!compiled)
+            return -1;
     }
 
     return 0;
@@ -0,0 +1,105 @@
+#include <time.h>
+#include <sys/resource.h>
+#include "compile_stats.h"
+
+#define NS_PER_MS 1000000.0
+#define NS_PER_S 1000000000.0
+#define BYTES_PER_MB (1024.0 * 1024.0)
+
+uint64_t compile_stats_clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+uint64_t compile_stats_start(const CompileStats* self)
+{
+    return self ? compile_stats_clock() : 0;
+}
+
+uint64_t compile_stats_stage(CompileStats* self, const CompileStage stage, const uint64_t start)
+{
+    if(!self)
+        return 0;
+
+    const uint64_t now = compile_stats_clock();
+    self->stage_ns[stage] += now - start;
+
+    return now;
+}
+
+void compile_stats_add(CompileStats* self, const CompileStats* other)
+{
+    for(uint32_t i = 0; i < StageCount; ++i)
+        self->stage_ns[i] += other->stage_ns[i];
+
+    self->total_ns += other->total_ns;
+    self->files += other->files;
+    self->lines += other->lines;
+    self->captions += other->captions;
+    self->bytes_in += other->bytes_in;
+    self->bytes_out += other->bytes_out;
+    self->blocks += other->blocks;
+    self->padding_bytes += other->padding_bytes;
+    self->allocations += other->allocations;
+    self->reallocations += other->reallocations;
+    if(other->peak_rss_kb > self->peak_rss_kb)
+        self->peak_rss_kb = other->peak_rss_kb;
+}
+
+void compile_stats_sample_memory(CompileStats* self)
+{
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0 && (uint64_t)usage.ru_maxrss > self->peak_rss_kb)
+        self->peak_rss_kb = usage.ru_maxrss;
+}
+
+const char* compile_stats_stage_name(const CompileStage stage)
+{
+    static const char* const names[StageCount] = {"read", "parse", "hash", "sort", "layout", "fill", "write"};
+
+    return (stage < StageCount) ? names[stage] : "unknown";
+}
+
+static double per_second(const double amount, const uint64_t ns)
+{
+    return ns ? amount * NS_PER_S / ns : 0.0;
+}
+
+void compile_stats_print(const CompileStats* self, FILE* file)
+{
+    fprintf(file, "%-8s %12s %8s\n", "Stage", "ms", "share");
+    for(uint32_t i = 0; i < StageCount; ++i)
+    {
+        fprintf(file, "%-8s %12.3f %7.1f%%\n", compile_stats_stage_name(i), self->stage_ns[i] / NS_PER_MS,
+                self->total_ns ? 100.0 * self->stage_ns[i] / self->total_ns : 0.0);
+    }
+    fprintf(file, "%-8s %12.3f\n\n", "total", self->total_ns / NS_PER_MS);
+
+    fprintf(file, "Files:          %lu\n", self->files);
+    fprintf(file, "Lines:          %lu\n", self->lines);
+    fprintf(file, "Captions:       %lu (%.0f per second)\n", self->captions, per_second(self->captions, self->total_ns));
+    fprintf(file, "Bytes in:       %lu (%.1f MB/s)\n", self->bytes_in, per_second(self->bytes_in / BYTES_PER_MB, self->total_ns));
+    fprintf(file, "Bytes out:      %lu\n", self->bytes_out);
+    fprintf(file, "Blocks:         %lu\n", self->blocks);
+    fprintf(file, "Padding bytes:  %lu\n", self->padding_bytes);
+    fprintf(file, "Allocations:    %lu\n", self->allocations);
+    fprintf(file, "Reallocations:  %lu\n", self->reallocations);
+    fprintf(file, "Peak RSS:       %lu KB\n", self->peak_rss_kb);
+}
+
+void compile_stats_print_json(const CompileStats* self, FILE* file)
+{
+    fprintf(file, "{\"stages_ms\":{");
+    for(uint32_t i = 0; i < StageCount; ++i)
+        fprintf(file, "%s\"%s\":%.3f", i ? "," : "", compile_stats_stage_name(i), self->stage_ns[i] / NS_PER_MS);
+
+    fprintf(file, "},\"total_ms\":%.3f,\"files\":%lu,\"lines\":%lu,\"captions\":%lu,\"bytes_in\":%lu,\"bytes_out\":%lu,"
+                  "\"blocks\":%lu,\"padding_bytes\":%lu,\"allocations\":%lu,\"reallocations\":%lu,\"peak_rss_kb\":%lu,"
+                  "\"mb_per_s\":%.3f,\"captions_per_s\":%.1f}\n",
+            self->total_ns / NS_PER_MS, self->files, self->lines, self->captions, self->bytes_in, self->bytes_out,
+            self->blocks, self->padding_bytes, self->allocations, self->reallocations, self->peak_rss_kb,
+            per_second(self->bytes_in / BYTES_PER_MB, self->total_ns), per_second(self->captions, self->total_ns));
+}
\ No newline at end of file
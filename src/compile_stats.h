@@ -0,0 +1,48 @@
+#ifndef COMPILE_STATS_H_INCLUDED
+#define COMPILE_STATS_H_INCLUDED
+
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum _CompileStage {
+    StageRead = 0, // Opening and mapping the source
+    StageParse,    // Splitting lines and finding keys and values
+    StageHash,     // Lowercasing and hashing keys, in a batch interning and ranking them as well
+    StageSort,     // Removing duplicates and sorting by key
+    StageLayout,
+    StageFill,
+    StageWrite,    // Writing the .dat and renaming it into place
+    StageCount,
+} CompileStage;
+
+// Where a run spent its time and what it produced. Stage times of files compiled
+// concurrently are added up, so together they can exceed total_ns.
+typedef struct _CompileStats {
+    uint64_t stage_ns[StageCount];
+    uint64_t total_ns;
+    uint64_t files, lines, captions;
+    uint64_t bytes_in, bytes_out;
+    uint64_t blocks, padding_bytes;
+    uint64_t allocations, reallocations; // Counted by the caller, the library doesn't count its own
+    uint64_t peak_rss_kb;
+} CompileStats;
+
+// Monotonic clock in nanoseconds
+uint64_t compile_stats_clock(void);
+
+// Both do nothing and return 0 when self is NULL, so untimed runs pay for a test only.
+// compile_stats_stage adds the time since start to stage and returns the clock to start the next one with.
+uint64_t compile_stats_start(const CompileStats* self);
+uint64_t compile_stats_stage(CompileStats* self, const CompileStage stage, const uint64_t start);
+
+void compile_stats_add(CompileStats* self, const CompileStats* other);
+
+// Peak resident set size of the process so far
+void compile_stats_sample_memory(CompileStats* self);
+
+const char* compile_stats_stage_name(const CompileStage stage);
+
+void compile_stats_print(const CompileStats* self, FILE* file);
+void compile_stats_print_json(const CompileStats* self, FILE* file);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,17 @@
+#ifndef CRC32_CLMUL_H_INCLUDED
+#define CRC32_CLMUL_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Smallest input the folding kernel accepts
+#define CRC32_CLMUL_MIN_LENGTH 64
+
+// Non-zero if the CPU has PCLMULQDQ and SSE4.1
+int crc32_clmul_available(void);
+
+// Folds len bytes into the running (pre-inverted) CRC state.
+// len must be at least CRC32_CLMUL_MIN_LENGTH and a multiple of 16.
+uint32_t crc32_clmul_update(uint32_t crc, const unsigned char* p, size_t len);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,707 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <memory.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dat_file.h"
+
+#define DECOMPILE_BATCH_SIZE 16384
+#define TASKS_PER_THREAD 4
+#define DECOMPILE_LINE_SIZE 96
+#define UTF8_PER_UCHAR 3
+#define RADIX_BITS 16
+#define DIFF_LINE_SIZE 160
+#define DIFF_FLUSH_SIZE (1 << 20)
+
+// A range of the directory checked by one task
+typedef struct _VerifyTask {
+    const DatFile* file;
+    const Caption* captions;
+    uint64_t first, last;
+    uint64_t bad_count;
+    uint64_t first_index;
+    DatMismatch first_mismatch;
+} VerifyTask;
+
+typedef struct _TextBuffer {
+    char* text;
+    uint64_t size, capacity;
+} TextBuffer;
+
+// One side of a diff, loaded and sorted by one task
+typedef struct _DiffSide {
+    const DatFile* file;
+    DatEntry* entries;
+    uint16_t* block_ends;
+    DatUsage* usage;
+    int error;
+} DiffSide;
+
+// Lines of a diff waiting to be written to fd
+typedef struct _DiffWriter {
+    TextBuffer out;
+    int fd;
+    const CaptionTable* keys;
+    uint64_t* keys_by_hash;
+} DiffWriter;
+
+// A range of the directory written out as text by one task
+typedef struct _DecompileTask {
+    const DatFile* file;
+    const CaptionTable* keys;
+    const uint64_t* keys_by_hash;
+    uint64_t first, last;
+    TextBuffer out;
+    uint64_t bad_count;
+    int error;
+} DecompileTask;
+
+int8_t dat_file_check_header(const Header* header, const uint64_t file_size)
+{
+    // Offsets are 16-bit and values are UChars, so blocks can't be larger than 32 KB and entries start on even offsets
+    return header->vccd == VCCD && header->version == VERSION && header->block_size > 0 && header->block_size <= 32768 &&
+           header->block_count >= 0 && header->dir_size >= 0 && header->data_offset % 2 == 0 &&
+           (uint64_t)header->data_offset >= HEADER_SIZE + (uint64_t)header->dir_size * DIR_ENTRY_SIZE &&
+           (uint64_t)header->data_offset + (uint64_t)header->block_count * header->block_size == file_size;
+}
+
+int8_t dat_file_check_entry(const Header* header, const DatEntry* entry)
+{
+    return entry->block >= 0 && entry->block < header->block_count && entry->offset >= 0 && entry->offset % 2 == 0 &&
+           entry->length >= (int16_t)sizeof(UChar) && entry->length % 2 == 0 && entry->offset + entry->length <= header->block_size;
+}
+
+DatFile* dat_file_open(const char* path)
+{
+    DatFile* file = (DatFile*)malloc(sizeof(DatFile));
+    if(!file)
+        return NULL;
+
+    const int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        free(file);
+        return NULL;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+        goto dat_file_open_error;
+
+    if(!S_ISREG(st.st_mode) || st.st_size < HEADER_SIZE)
+    {
+        errno = EBADMSG;
+        goto dat_file_open_error;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(data == MAP_FAILED)
+        goto dat_file_open_error;
+
+    close(fd);
+
+    file->data = (const char*)data;
+    file->size = st.st_size;
+    memcpy(&file->header, file->data, HEADER_SIZE);
+
+    if(!dat_file_check_header(&file->header, file->size))
+    {
+        munmap(data, file->size);
+        free(file);
+        errno = EBADMSG;
+        return NULL;
+    }
+
+    file->directory = file->data + HEADER_SIZE;
+    file->blocks = file->data + file->header.data_offset;
+
+    return file;
+
+    dat_file_open_error:
+    {
+        const int error = errno;
+        close(fd);
+        free(file);
+        errno = error;
+    }
+
+    return NULL;
+}
+
+void dat_file_entry(const DatFile* self, const uint64_t index, DatEntry* entry)
+{
+    const char* data = self->directory + index * DIR_ENTRY_SIZE;
+
+    memcpy(&entry->hash, data, sizeof(uint32_t));
+    memcpy(&entry->block, data + 4, sizeof(int32_t));
+    memcpy(&entry->offset, data + 8, sizeof(int16_t));
+    memcpy(&entry->length, data + 10, sizeof(int16_t));
+}
+
+const UChar* dat_file_value(const DatFile* self, const DatEntry* entry, uint32_t* length)
+{
+    if(!dat_file_check_entry(&self->header, entry))
+        return NULL;
+
+    const UChar* value = (const UChar*)(self->blocks + (uint64_t)entry->block * self->header.block_size + entry->offset);
+    *length = entry->length / sizeof(UChar) - 1;
+
+    return (value[*length] == 0) ? value : NULL;
+}
+
+int8_t dat_file_sort_entries(DatEntry** entries, const uint64_t n)
+{
+    DatEntry* scratch = (DatEntry*)malloc((n ? n : 1) * sizeof(DatEntry));
+    uint64_t* counts = (uint64_t*)malloc((1 << RADIX_BITS) * sizeof(uint64_t));
+    if(!scratch || !counts)
+    {
+        free(scratch);
+        free(counts);
+        return 0;
+    }
+
+    DatEntry* from = *entries;
+    DatEntry* to = scratch;
+    for(uint32_t shift = 0; shift < 32; shift += RADIX_BITS)
+    {
+        memset(counts, 0, (1 << RADIX_BITS) * sizeof(uint64_t));
+        for(uint64_t i = 0; i < n; ++i)
+            ++counts[(from[i].hash >> shift) & ((1 << RADIX_BITS) - 1)];
+
+        uint64_t sum = 0;
+        for(uint32_t i = 0; i < (1 << RADIX_BITS); ++i)
+        {
+            const uint64_t count = counts[i];
+            counts[i] = sum;
+            sum += count;
+        }
+
+        for(uint64_t i = 0; i < n; ++i)
+            to[counts[(from[i].hash >> shift) & ((1 << RADIX_BITS) - 1)]++] = from[i];
+
+        DatEntry* temp = from;
+        from = to;
+        to = temp;
+    }
+
+    free(to);
+    *entries = from;
+    free(counts);
+
+    return 1;
+}
+
+static DatMismatch verify_entry(const DatFile* file, const Caption* caption, const uint64_t index)
+{
+    DatEntry entry;
+    dat_file_entry(file, index, &entry);
+
+    if(entry.hash != caption->hash)
+        return DatWrongHash;
+
+    if(entry.block != caption->block || entry.offset != caption->offset || entry.length != (int16_t)((caption->value_size + 1) * sizeof(UChar)))
+        return DatWrongPlace;
+
+    uint32_t length = 0;
+    const UChar* value = dat_file_value(file, &entry, &length);
+    if(!value)
+        return DatBadRange;
+
+    return (memcmp(value, caption->value, length * sizeof(UChar)) == 0) ? DatMatch : DatWrongValue;
+}
+
+static void verify_task(void* data)
+{
+    VerifyTask* task = (VerifyTask*)data;
+
+    for(uint64_t i = task->first; i < task->last; ++i)
+    {
+        const DatMismatch mismatch = verify_entry(task->file, &task->captions[i], i);
+        if(__builtin_expect(mismatch != DatMatch, 0))
+        {
+            if(!task->bad_count++)
+            {
+                task->first_index = i;
+                task->first_mismatch = mismatch;
+            }
+        }
+    }
+}
+
+int64_t dat_file_verify(const DatFile* self, const CaptionTable* table, ThreadPool* pool, uint64_t* first_index, DatMismatch* first_mismatch)
+{
+    *first_index = 0;
+    *first_mismatch = DatMatch;
+
+    // Nothing lines up if the counts don't; dat_file_open has made sure dir_size isn't negative
+    const uint64_t dir_size = self->header.dir_size;
+    if(dir_size != table->size)
+    {
+        *first_index = (dir_size < table->size) ? dir_size : table->size;
+        *first_mismatch = DatWrongHash;
+        return 1;
+    }
+
+    const uint32_t task_count = (pool->thread_count + 1) * TASKS_PER_THREAD;
+    VerifyTask* tasks = (VerifyTask*)malloc(task_count * sizeof(VerifyTask));
+    if(!tasks)
+        return -1;
+
+    for(uint32_t i = 0; i < task_count; ++i)
+        tasks[i] = (VerifyTask){self, table->data, table->size * i / task_count, table->size * (i + 1) / task_count, 0, 0, DatMatch};
+
+    thread_pool_run(pool, verify_task, tasks, sizeof(VerifyTask), task_count);
+
+    // Tasks are in directory order, so the first one with a mismatch has the first mismatch
+    int64_t bad_count = 0;
+    for(uint32_t i = 0; i < task_count; ++i)
+    {
+        if(tasks[i].bad_count && !bad_count)
+        {
+            *first_index = tasks[i].first_index;
+            *first_mismatch = tasks[i].first_mismatch;
+        }
+        bad_count += tasks[i].bad_count;
+    }
+    free(tasks);
+
+    return bad_count;
+}
+
+static int compare_hashes(const void* a, const void* b)
+{
+    const uint64_t left = *(const uint64_t*)a;
+    const uint64_t right = *(const uint64_t*)b;
+
+    return (left > right) - (left < right);
+}
+
+// Hash above index, sorted, for a binary search per entry
+static uint64_t* index_keys(const CaptionTable* keys)
+{
+    uint64_t* keys_by_hash = (uint64_t*)malloc(keys->size * sizeof(uint64_t));
+    if(!keys_by_hash)
+        return NULL;
+
+    for(uint64_t i = 0; i < keys->size; ++i)
+        keys_by_hash[i] = ((uint64_t)keys->data[i].hash << 32) | i;
+    qsort(keys_by_hash, keys->size, sizeof(uint64_t), compare_hashes);
+
+    return keys_by_hash;
+}
+
+static const Caption* find_key(const CaptionTable* keys, const uint64_t* keys_by_hash, const uint32_t hash)
+{
+    uint64_t low = 0, high = keys ? keys->size : 0;
+    while(low < high)
+    {
+        const uint64_t middle = (low + high) >> 1;
+        if((keys_by_hash[middle] >> 32) < hash)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    return (low < (keys ? keys->size : 0) && (keys_by_hash[low] >> 32) == hash) ? &keys->data[(uint32_t)keys_by_hash[low]] : NULL;
+}
+
+static int8_t reserve_text(TextBuffer* buffer, const uint64_t n)
+{
+    if(buffer->size + n <= buffer->capacity)
+        return 1;
+
+    uint64_t new_capacity = buffer->capacity ? buffer->capacity << 1 : 65536;
+    while(new_capacity < buffer->size + n)
+        new_capacity <<= 1;
+
+    char* new_text = (char*)realloc(buffer->text, new_capacity);
+    if(!new_text)
+        return 0;
+
+    buffer->text = new_text;
+    buffer->capacity = new_capacity;
+
+    return 1;
+}
+
+static void append_utf8(TextBuffer* buffer, const UChar* data, const uint32_t length)
+{
+    UErrorCode error = U_ZERO_ERROR;
+    int32_t written = 0;
+
+    u_strToUTF8WithSub(buffer->text + buffer->size, buffer->capacity - buffer->size, &written, data, length, 0xFFFD, NULL, &error);
+    buffer->size += written;
+}
+
+static void append_text(TextBuffer* buffer, const char* text, const uint64_t length)
+{
+    memcpy(buffer->text + buffer->size, text, length);
+    buffer->size += length;
+}
+
+// Quoted key, or its hash when it isn't known
+static void append_key(TextBuffer* buffer, const Caption* key, const uint32_t hash)
+{
+    buffer->text[buffer->size++] = '\"';
+    if(key)
+        append_utf8(buffer, key->key, key->key_size);
+    else
+        buffer->size += sprintf(buffer->text + buffer->size, "0x%08x", hash);
+    buffer->text[buffer->size++] = '\"';
+}
+
+static void decompile_task(void* data)
+{
+    DecompileTask* task = (DecompileTask*)data;
+    DatEntry entry;
+
+    for(uint64_t i = task->first; i < task->last; ++i)
+    {
+        dat_file_entry(task->file, i, &entry);
+
+        uint32_t value_length = 0;
+        const UChar* value = dat_file_value(task->file, &entry, &value_length);
+        const Caption* key = find_key(task->keys, task->keys_by_hash, entry.hash);
+
+        TextBuffer* out = &task->out;
+        if(!reserve_text(out, DECOMPILE_LINE_SIZE + (uint64_t)((key ? key->key_size : 0) + value_length) * UTF8_PER_UCHAR))
+        {
+            task->error = errno;
+            return;
+        }
+
+        append_key(out, key, entry.hash);
+        append_text(out, " \"", 2);
+
+        if(value)
+            append_utf8(out, value, value_length);
+        else
+            ++task->bad_count;
+
+        out->size += sprintf(out->text + out->size, "\" // hash %u block %d offset %hd%s\n", entry.hash, entry.block, entry.offset, value ? "" : " invalid value");
+    }
+}
+
+static int8_t write_all(const int fd, const char* data, uint64_t size)
+{
+    while(size)
+    {
+        const ssize_t n = write(fd, data, size);
+        if(n < 0 && errno == EINTR)
+            continue;
+        if(n <= 0)
+        {
+            if(n == 0)
+                errno = EIO;
+            return 0;
+        }
+
+        data += n;
+        size -= n;
+    }
+
+    return 1;
+}
+
+int64_t dat_file_decompile(const DatFile* self, const CaptionTable* keys, const int fd, ThreadPool* pool)
+{
+    static const char start[] = "\"lang\"\n{\n\"Tokens\"\n{\n";
+    static const char end[] = "}\n}\n";
+
+    const uint64_t entry_count = self->header.dir_size;
+    const uint32_t task_count = (pool->thread_count + 1) * TASKS_PER_THREAD;
+    int64_t bad_count = -1;
+
+    uint64_t* keys_by_hash = NULL;
+    DecompileTask* tasks = (DecompileTask*)calloc(task_count, sizeof(DecompileTask));
+    if(!tasks)
+        return -1;
+
+    if(keys && keys->size && !(keys_by_hash = index_keys(keys)))
+        goto dat_file_decompile_end;
+
+    madvise((void*)self->data, self->size, MADV_SEQUENTIAL);
+
+    if(!write_all(fd, start, sizeof(start) - 1))
+        goto dat_file_decompile_end;
+
+    // Batches bound the text held at once, each one is decoded in parallel and written in order
+    int64_t total_bad = 0;
+    for(uint64_t batch = 0; batch < entry_count; batch += DECOMPILE_BATCH_SIZE)
+    {
+        const uint64_t batch_size = (entry_count - batch < DECOMPILE_BATCH_SIZE) ? entry_count - batch : DECOMPILE_BATCH_SIZE;
+        for(uint32_t i = 0; i < task_count; ++i)
+        {
+            DecompileTask* task = &tasks[i];
+            task->file = self;
+            task->keys = keys_by_hash ? keys : NULL;
+            task->keys_by_hash = keys_by_hash;
+            task->first = batch + batch_size * i / task_count;
+            task->last = batch + batch_size * (i + 1) / task_count;
+            task->out.size = 0;
+            task->bad_count = 0;
+            task->error = 0;
+        }
+
+        thread_pool_run(pool, decompile_task, tasks, sizeof(DecompileTask), task_count);
+
+        for(uint32_t i = 0; i < task_count; ++i)
+        {
+            if(tasks[i].error)
+            {
+                errno = tasks[i].error;
+                goto dat_file_decompile_end;
+            }
+
+            if(!write_all(fd, tasks[i].out.text, tasks[i].out.size))
+                goto dat_file_decompile_end;
+            total_bad += tasks[i].bad_count;
+        }
+    }
+
+    if(write_all(fd, end, sizeof(end) - 1))
+        bad_count = total_bad;
+
+    dat_file_decompile_end:
+    {
+        for(uint32_t i = 0; i < task_count; ++i)
+            free(tasks[i].out.text);
+        free(tasks);
+        free(keys_by_hash);
+    }
+
+    return bad_count;
+}
+
+// Reads the directory sorted by hash and where the last value of every block ends
+static void diff_side_task(void* data)
+{
+    DiffSide* side = (DiffSide*)data;
+    const Header* header = &side->file->header;
+    const uint64_t n = header->dir_size;
+
+    side->entries = (DatEntry*)malloc((n ? n : 1) * sizeof(DatEntry));
+    side->block_ends = (uint16_t*)calloc(header->block_count ? header->block_count : 1, sizeof(uint16_t));
+    if(!side->entries || !side->block_ends)
+    {
+        side->error = errno;
+        return;
+    }
+
+    DatUsage* usage = side->usage;
+    usage->entry_count = n;
+    usage->block_count = header->block_count;
+    usage->header_padding = header->data_offset - HEADER_SIZE - n * DIR_ENTRY_SIZE;
+
+    for(uint64_t i = 0; i < n; ++i)
+    {
+        DatEntry* entry = &side->entries[i];
+        dat_file_entry(side->file, i, entry);
+        if(!dat_file_check_entry(header, entry))
+            continue;
+
+        usage->value_bytes += entry->length;
+        const uint16_t end = entry->offset + entry->length;
+        if(end > side->block_ends[entry->block])
+            side->block_ends[entry->block] = end;
+    }
+
+    for(int32_t i = 0; i < header->block_count; ++i)
+        usage->used_bytes += side->block_ends[i];
+    usage->padding_bytes = (uint64_t)header->block_count * header->block_size - usage->used_bytes;
+
+    if(!dat_file_sort_entries(&side->entries, n))
+        side->error = errno;
+}
+
+static int8_t flush_diff(DiffWriter* writer, const uint64_t threshold)
+{
+    if(writer->out.size < threshold)
+        return 1;
+
+    const int8_t written = write_all(writer->fd, writer->out.text, writer->out.size);
+    writer->out.size = 0;
+
+    return written;
+}
+
+// Makes room for a line with up to two values of one entry and writes its kind and key
+static int8_t start_diff_line(DiffWriter* writer, const char* kind, const uint32_t hash, const uint32_t value_length)
+{
+    const Caption* key = find_key(writer->keys, writer->keys_by_hash, hash);
+    if(!reserve_text(&writer->out, DIFF_LINE_SIZE + (uint64_t)((key ? key->key_size : 0) + value_length) * UTF8_PER_UCHAR))
+        return 0;
+
+    append_text(&writer->out, kind, strlen(kind));
+    append_key(&writer->out, key, hash);
+
+    return 1;
+}
+
+// added or removed: the entry with its value and place
+static int8_t diff_entry(DiffWriter* writer, const char* kind, const DatFile* file, const DatEntry* entry)
+{
+    uint32_t length = 0;
+    const UChar* value = dat_file_value(file, entry, &length);
+    if(!start_diff_line(writer, kind, entry->hash, length))
+        return 0;
+
+    TextBuffer* out = &writer->out;
+    append_text(out, " \"", 2);
+    if(value)
+        append_utf8(out, value, length);
+    out->size += sprintf(out->text + out->size, "\" // hash %u block %d offset %hd%s\n", entry->hash, entry->block, entry->offset, value ? "" : " invalid value");
+
+    return flush_diff(writer, DIFF_FLUSH_SIZE);
+}
+
+// changed: both values; moved: only the blocks
+static int8_t diff_pair(DiffWriter* writer, const char* kind, const UChar* old_value, const uint32_t old_length, const UChar* new_value,
+                        const uint32_t new_length, const DatEntry* old_entry, const DatEntry* new_entry, const int8_t with_values)
+{
+    if(!start_diff_line(writer, kind, new_entry->hash, with_values ? old_length + new_length : 0))
+        return 0;
+
+    TextBuffer* out = &writer->out;
+    if(with_values)
+    {
+        append_text(out, " \"", 2);
+        if(old_value)
+            append_utf8(out, old_value, old_length);
+        append_text(out, "\" -> \"", 6);
+        if(new_value)
+            append_utf8(out, new_value, new_length);
+        append_text(out, "\"", 1);
+    }
+    out->size += sprintf(out->text + out->size, " // hash %u block %d -> %d%s\n", new_entry->hash, old_entry->block, new_entry->block,
+                         (old_value && new_value) ? "" : " invalid value");
+
+    return flush_diff(writer, DIFF_FLUSH_SIZE);
+}
+
+// Compares two entries with the same hash, 0 with errno set if the line couldn't be written
+static int8_t diff_common(DiffWriter* writer, const DatFile* old_file, const DatEntry* old_entry, const DatFile* new_file,
+                          const DatEntry* new_entry, DatDiff* diff)
+{
+    uint32_t old_length = 0, new_length = 0;
+    const UChar* old_value = dat_file_value(old_file, old_entry, &old_length);
+    const UChar* new_value = dat_file_value(new_file, new_entry, &new_length);
+
+    if(!old_value || !new_value)
+        ++diff->invalid;
+
+    const int8_t same = old_value && new_value && old_length == new_length && memcmp(old_value, new_value, old_length * sizeof(UChar)) == 0;
+    if(!same)
+    {
+        ++diff->changed;
+        return diff_pair(writer, "changed ", old_value, old_length, new_value, new_length, old_entry, new_entry, 1);
+    }
+
+    if(old_entry->block != new_entry->block)
+    {
+        ++diff->moved;
+        return diff_pair(writer, "moved   ", old_value, old_length, new_value, new_length, old_entry, new_entry, 0);
+    }
+
+    if(old_entry->offset != new_entry->offset)
+        ++diff->shifted;
+
+    return 1;
+}
+
+int64_t dat_file_diff(const DatFile* old_file, const DatFile* new_file, const CaptionTable* keys, const int fd, ThreadPool* pool, DatDiff* diff)
+{
+    int64_t difference_count = -1;
+
+    memset(diff, 0, sizeof(DatDiff));
+    diff->first_block_changed = -1;
+
+    DiffSide sides[2] = {{old_file, NULL, NULL, &diff->usage[0], 0}, {new_file, NULL, NULL, &diff->usage[1], 0}};
+    DiffWriter writer = {{NULL, 0, 0}, fd, NULL, NULL};
+
+    if(keys && keys->size)
+    {
+        if(!(writer.keys_by_hash = index_keys(keys)))
+            goto dat_file_diff_end;
+        writer.keys = keys;
+    }
+
+    thread_pool_run(pool, diff_side_task, sides, sizeof(DiffSide), 2);
+    for(uint32_t i = 0; i < 2; ++i)
+    {
+        if(sides[i].error)
+        {
+            errno = sides[i].error;
+            goto dat_file_diff_end;
+        }
+    }
+
+    // Both directories are sorted by hash, so one pass pairs up every key
+    const DatEntry* old_entries = sides[0].entries;
+    const DatEntry* new_entries = sides[1].entries;
+    const uint64_t old_count = old_file->header.dir_size, new_count = new_file->header.dir_size;
+    uint64_t i = 0, j = 0;
+    while(i < old_count || j < new_count)
+    {
+        int8_t written;
+        if(j == new_count || (i < old_count && old_entries[i].hash < new_entries[j].hash))
+        {
+            ++diff->removed;
+            written = diff_entry(&writer, "removed ", old_file, &old_entries[i++]);
+        }
+        else if(i == old_count || new_entries[j].hash < old_entries[i].hash)
+        {
+            ++diff->added;
+            written = diff_entry(&writer, "added   ", new_file, &new_entries[j++]);
+        }
+        else
+        {
+            written = diff_common(&writer, old_file, &old_entries[i], new_file, &new_entries[j], diff);
+            ++i;
+            ++j;
+        }
+
+        if(!written)
+            goto dat_file_diff_end;
+    }
+
+    if(!flush_diff(&writer, 1))
+        goto dat_file_diff_end;
+
+    const int32_t common_blocks = (diff->usage[0].block_count < diff->usage[1].block_count) ? diff->usage[0].block_count : diff->usage[1].block_count;
+    for(int32_t block = 0; block < common_blocks; ++block)
+    {
+        if(sides[0].block_ends[block] != sides[1].block_ends[block])
+        {
+            if(!diff->blocks_changed++)
+                diff->first_block_changed = block;
+        }
+    }
+
+    difference_count = diff->added + diff->removed + diff->changed + diff->moved;
+
+    dat_file_diff_end:
+    {
+        const int error = errno;
+        for(uint32_t k = 0; k < 2; ++k)
+        {
+            free(sides[k].entries);
+            free(sides[k].block_ends);
+        }
+        free(writer.out.text);
+        free(writer.keys_by_hash);
+        errno = error;
+    }
+
+    return difference_count;
+}
+
+void dat_file_destroy(DatFile** self)
+{
+    munmap((void*)(*self)->data, (*self)->size);
+    free(*self);
+    *self = NULL;
+}
\ No newline at end of file
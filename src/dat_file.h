@@ -0,0 +1,87 @@
+#ifndef DAT_FILE_H_INCLUDED
+#define DAT_FILE_H_INCLUDED
+
+#include "caption_compile.h"
+
+// A compiled .dat, mapped read only. directory and blocks point into the mapping.
+typedef struct _DatFile {
+    const char* data;
+    uint64_t size;
+    Header header;
+    const char* directory;
+    const char* blocks;
+} DatFile;
+
+typedef struct _DatEntry {
+    uint32_t hash;
+    int32_t block;
+    int16_t offset;
+    int16_t length;
+} DatEntry;
+
+// Whether a header read from a file of file_size bytes is one this compiler could have written
+int8_t dat_file_check_header(const Header* header, const uint64_t file_size);
+
+// Whether the range of an entry lies inside one block of a file with this header
+int8_t dat_file_check_entry(const Header* header, const DatEntry* entry);
+
+// Maps path and checks that the header describes a file of its size.
+// Returns NULL with errno set, EBADMSG if it isn't a valid .dat.
+DatFile* dat_file_open(const char* path);
+
+void dat_file_entry(const DatFile* self, const uint64_t index, DatEntry* entry);
+
+// Value of an entry without its terminating '\0', NULL if its range isn't inside a block or isn't terminated
+const UChar* dat_file_value(const DatFile* self, const DatEntry* entry, uint32_t* length);
+
+// Sorts entries by hash in linear time, stable for equal hashes. *entries may be replaced by another array.
+// Returns 0 with errno set when out of memory, leaving *entries untouched.
+int8_t dat_file_sort_entries(DatEntry** entries, const uint64_t n);
+
+typedef enum _DatMismatch {
+    DatMatch = 0,
+    DatWrongHash,      // Directory order differs from the table
+    DatWrongPlace,     // Block, offset or length differ from the layout
+    DatBadRange,       // Outside a block or not terminated
+    DatWrongValue,
+} DatMismatch;
+
+// Checks the file against the sorted, laid out table it was written from: one entry per caption in the
+// same order, each pointing where the layout put it at a terminated copy of its value. Entries are
+// checked in parallel. Returns the number of entries that differ, with the first one and why in
+// first_index and first_mismatch, or -1 with errno set.
+int64_t dat_file_verify(const DatFile* self, const CaptionTable* table, ThreadPool* pool, uint64_t* first_index, DatMismatch* first_mismatch);
+
+// Writes every entry as a source line to fd in directory order, UTF-8 encoded, with its hash, block and offset
+// in a comment. Keys are looked up by hash in keys, a table of hashed captions, and written as their hash
+// when missing. Returns the number of entries whose value couldn't be read, or -1 with errno set.
+int64_t dat_file_decompile(const DatFile* self, const CaptionTable* keys, const int fd, ThreadPool* pool);
+
+// How one file fills its blocks. A block is used from its start to the end of its last value.
+typedef struct _DatUsage {
+    uint64_t entry_count;
+    uint64_t value_bytes;    // Sum of the entry lengths, more than used_bytes when values are shared
+    uint64_t used_bytes;
+    uint64_t padding_bytes;  // Left at the end of the blocks
+    uint64_t header_padding; // Between the directory and the first block
+    int32_t block_count;
+} DatUsage;
+
+typedef struct _DatDiff {
+    DatUsage usage[2];
+    uint64_t added, removed, changed, moved;
+    uint64_t shifted;  // Same value and block, another offset
+    uint64_t invalid;  // Entries in both files with a value that couldn't be read in either
+    int32_t blocks_changed;      // Blocks in both files that end elsewhere
+    int32_t first_block_changed; // -1 when there are none
+} DatDiff;
+
+// Pairs the entries of both files by hash and writes a line to fd, in hash order, for every one that was added,
+// removed, changed in value or moved to another block, with keys from keys as dat_file_decompile does.
+// Both directories are sorted in parallel in linear time. Fills diff with the counts and the block usage
+// of both files. Returns the number of entries listed, or -1 with errno set.
+int64_t dat_file_diff(const DatFile* old_file, const DatFile* new_file, const CaptionTable* keys, const int fd, ThreadPool* pool, DatDiff* diff);
+
+void dat_file_destroy(DatFile** self);
+
+#endif
\ No newline at end of file
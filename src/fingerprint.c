@@ -0,0 +1,101 @@
+#include <memory.h>
+#include "fingerprint.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotate_left(const uint64_t x, const uint32_t r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const unsigned char* p)
+{
+    uint64_t value;
+    memcpy(&value, p, sizeof(uint64_t));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char* p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(uint32_t));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+}
+
+static inline uint64_t round64(uint64_t accumulator, const uint64_t input)
+{
+    accumulator += input * PRIME64_2;
+    return rotate_left(accumulator, 31) * PRIME64_1;
+}
+
+static inline uint64_t merge64(uint64_t accumulator, const uint64_t value)
+{
+    accumulator ^= round64(0, value);
+    return accumulator * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t fingerprint64(const void* data, const uint64_t size)
+{
+    register const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* const end = p + size;
+    uint64_t hash;
+
+    // Four independent lanes over 32 byte stripes
+    if(size >= 32)
+    {
+        uint64_t v1 = PRIME64_1 + PRIME64_2;
+        uint64_t v2 = PRIME64_2;
+        uint64_t v3 = 0;
+        uint64_t v4 = -PRIME64_1;
+
+        do
+        {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+            p += 32;
+        } while(end - p >= 32);
+
+        hash = rotate_left(v1, 1) + rotate_left(v2, 7) + rotate_left(v3, 12) + rotate_left(v4, 18);
+        hash = merge64(hash, v1);
+        hash = merge64(hash, v2);
+        hash = merge64(hash, v3);
+        hash = merge64(hash, v4);
+    }
+    else
+        hash = PRIME64_5;
+
+    hash += size;
+
+    for(; end - p >= 8; p += 8)
+        hash = rotate_left(hash ^ round64(0, read64(p)), 27) * PRIME64_1 + PRIME64_4;
+
+    if(end - p >= 4)
+    {
+        hash = rotate_left(hash ^ (read32(p) * PRIME64_1), 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+
+    for(; p < end; ++p)
+        hash = rotate_left(hash ^ (*p * PRIME64_5), 11) * PRIME64_1;
+
+    // Avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#ifndef FINGERPRINT_H_INCLUDED
+#define FINGERPRINT_H_INCLUDED
+
+#include <stdint.h>
+
+// 64-bit non-cryptographic hash (the XXH64 algorithm), for telling apart contents that CRC32 could confuse
+uint64_t fingerprint64(const void* data, const uint64_t size);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "source_file.h"
+#include "ustring_scan.h"
+
+#define READ_CHUNK_SIZE 65536
+
+// Fallback for pipes and anything else that can't be mapped
+static SourceFile* read_stream(SourceFile* file, const int fd)
+{
+    uint64_t capacity = 0, length = 0;
+    char* data = NULL;
+
+    while(1)
+    {
+        if(length == capacity)
+        {
+            const uint64_t new_capacity = capacity ? capacity << 1 : READ_CHUNK_SIZE;
+            char* new_data = (char*)realloc(data, new_capacity);
+            if(!new_data)
+            {
+                free(data);
+                return NULL;
+            }
+
+            data = new_data;
+            capacity = new_capacity;
+        }
+
+        const ssize_t n = read(fd, data + length, capacity - length);
+        if(n == 0)
+            break;
+
+        if(n < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            free(data);
+            return NULL;
+        }
+
+        length += n;
+    }
+
+    file->data = (UChar*)data;
+    file->size = length / sizeof(UChar);
+
+    return file;
+}
+
+SourceFile* source_file_init(const char* filename)
+{
+    SourceFile* file = (SourceFile*)malloc(sizeof(SourceFile));
+    if(!file)
+        return NULL;
+
+    file->data = NULL;
+    file->size = 0;
+    file->position = 0;
+    file->mapped_length = 0;
+
+    const int fd = open(filename, O_RDONLY);
+    if(fd < 0)
+    {
+        free(file);
+        return NULL;
+    }
+
+    struct stat st;
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        // Private mapping, so lines can be fixed up in place without touching the file
+        void* data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if(data != MAP_FAILED)
+        {
+            madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+            file->data = (UChar*)data;
+            file->size = st.st_size / sizeof(UChar);
+            file->mapped_length = st.st_size;
+        }
+    }
+
+    if(!file->mapped_length && !read_stream(file, fd))
+    {
+        const int error = errno;
+        close(fd);
+        free(file);
+        errno = error;
+        return NULL;
+    }
+
+    close(fd);
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for(uint64_t i = 0; i < file->size; ++i)
+        file->data[i] = __builtin_bswap16(file->data[i]);
+#endif
+
+    return file;
+}
+
+// Mirrors what the UFILE converter and ustring_getline used to do:
+// drop every '\r' and turn unpaired surrogates into U+FFFD
+static uint32_t fixup_line(UChar* start, const UChar* end)
+{
+    register const UChar* r = start;
+    register UChar* w = start;
+
+    while(r < end)
+    {
+        UChar ch = *r++;
+        if(ch == u'\r')
+            continue;
+
+        if(U16_IS_LEAD(ch) && r < end && U16_IS_TRAIL(*r))
+        {
+            *w++ = ch;
+            *w++ = *r++;
+            continue;
+        }
+
+        if(U16_IS_SURROGATE(ch))
+            ch = 0xFFFD;
+
+        *w++ = ch;
+    }
+
+    return w - start;
+}
+
+UStringView* source_file_getline(SourceFile* self, UStringView* line)
+{
+    UChar* const start = self->data + self->position;
+    const UChar* const end = self->data + self->size;
+    uint8_t needs_fixup = 0;
+
+    UChar* const s = (UChar*)ustring_find_line_end(start, end, &needs_fixup);
+
+    self->position = (s - self->data) + (s < end);
+
+    line->data = start;
+    line->size = needs_fixup ? fixup_line(start, s) : s - start;
+
+    return line;
+}
+
+void source_file_skip(SourceFile* self, const uint64_t n)
+{
+    self->position = (self->position + n < self->size) ? self->position + n : self->size;
+}
+
+int8_t source_file_eof(const SourceFile* self)
+{
+    return self->position >= self->size;
+}
+
+void source_file_destroy(SourceFile** self)
+{
+    if((*self)->mapped_length)
+        munmap((*self)->data, (*self)->mapped_length);
+    else
+        free((*self)->data);
+
+    free(*self);
+    *self = NULL;
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#ifndef SOURCE_FILE_H_INCLUDED
+#define SOURCE_FILE_H_INCLUDED
+
+#include "ustring.h"
+
+typedef struct _SourceFile {
+    UChar* data;
+    uint64_t size;
+    uint64_t position;
+    uint64_t mapped_length;
+} SourceFile;
+
+SourceFile* source_file_init(const char* filename);
+UStringView* source_file_getline(SourceFile* self, UStringView* line);
+
+void source_file_skip(SourceFile* self, const uint64_t n);
+int8_t source_file_eof(const SourceFile* self);
+void source_file_destroy(SourceFile** self);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,143 @@
+#include <stdlib.h>
+#include "thread_pool.h"
+
+// Non-zero while the current thread is executing a task
+static __thread uint32_t task_depth = 0;
+
+static void run_task(ThreadPool* self, const uint32_t index)
+{
+    ++task_depth;
+    self->function(self->tasks + index * self->task_size);
+    --task_depth;
+}
+
+static void* worker_main(void* data)
+{
+    ThreadPool* pool = (ThreadPool*)data;
+
+    pthread_mutex_lock(&pool->lock);
+    while(1)
+    {
+        while(!pool->stop && pool->next_task >= pool->task_count)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+
+        if(pool->stop)
+            break;
+
+        const uint32_t index = pool->next_task++;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_task(pool, index);
+
+        pthread_mutex_lock(&pool->lock);
+        if(++pool->finished_tasks == pool->task_count)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+ThreadPool* thread_pool_init(const uint32_t n)
+{
+    ThreadPool* pool = (ThreadPool*)malloc(sizeof(ThreadPool));
+    if(!pool)
+        return NULL;
+
+    pool->thread_count = 0;
+    pool->task_count = 0;
+    pool->next_task = 0;
+    pool->finished_tasks = 0;
+    pool->stop = 0;
+
+    pool->threads = (pthread_t*)malloc((n > 1 ? n - 1 : 1) * sizeof(pthread_t));
+    if(!pool->threads)
+    {
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->run_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for(uint32_t i = 1; i < n; ++i)
+    {
+        if(pthread_create(&pool->threads[pool->thread_count], NULL, worker_main, pool) != 0)
+        {
+            thread_pool_destroy(&pool);
+            return NULL;
+        }
+        ++pool->thread_count;
+    }
+
+    return pool;
+}
+
+void thread_pool_run(ThreadPool* self, ThreadTask function, void* tasks, const size_t task_size, const uint32_t task_count)
+{
+    if(!self->thread_count || task_depth || task_count <= 1)
+    {
+        for(uint32_t i = 0; i < task_count; ++i)
+        {
+            ++task_depth;
+            function((char*)tasks + i * task_size);
+            --task_depth;
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&self->run_lock);
+    pthread_mutex_lock(&self->lock);
+
+    self->function = function;
+    self->tasks = (char*)tasks;
+    self->task_size = task_size;
+    self->task_count = task_count;
+    self->next_task = 0;
+    self->finished_tasks = 0;
+    pthread_cond_broadcast(&self->wake);
+
+    while(self->next_task < self->task_count)
+    {
+        const uint32_t index = self->next_task++;
+        pthread_mutex_unlock(&self->lock);
+
+        run_task(self, index);
+
+        pthread_mutex_lock(&self->lock);
+        ++self->finished_tasks;
+    }
+
+    while(self->finished_tasks < self->task_count)
+        pthread_cond_wait(&self->done, &self->lock);
+
+    self->task_count = 0;
+    self->next_task = 0;
+
+    pthread_mutex_unlock(&self->lock);
+    pthread_mutex_unlock(&self->run_lock);
+}
+
+void thread_pool_destroy(ThreadPool** self)
+{
+    ThreadPool* pool = *self;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for(uint32_t i = 0; i < pool->thread_count; ++i)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_mutex_destroy(&pool->run_lock);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+
+    free(pool->threads);
+    free(pool);
+    *self = NULL;
+}
\ No newline at end of file
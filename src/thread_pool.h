@@ -0,0 +1,37 @@
+#ifndef THREAD_POOL_H_INCLUDED
+#define THREAD_POOL_H_INCLUDED
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+typedef void (*ThreadTask)(void* task);
+
+typedef struct _ThreadPool {
+    pthread_t* threads;
+    uint32_t thread_count;
+
+    pthread_mutex_t run_lock;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+
+    ThreadTask function;
+    char* tasks;
+    size_t task_size;
+    uint32_t task_count;
+    uint32_t next_task;
+    uint32_t finished_tasks;
+    uint8_t stop;
+} ThreadPool;
+
+// The calling thread takes part in every run, so n threads means n - 1 workers
+ThreadPool* thread_pool_init(const uint32_t n);
+
+// Calls function on each of the task_count structs of task_size bytes in tasks and waits for all of them.
+// Runs from inside a task are executed inline on the calling thread.
+void thread_pool_run(ThreadPool* self, ThreadTask function, void* tasks, const size_t task_size, const uint32_t task_count);
+
+void thread_pool_destroy(ThreadPool** self);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,304 @@
+#include <unicode/uchar.h>
+#include "ustring_scan.h"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define USCAN_X86 1
+#endif
+
+// Scalar versions, used for tails and on targets without SSE2
+
+static const UChar* find_line_end_scalar(const UChar* s, const UChar* end, uint8_t* needs_fixup)
+{
+    while(s < end && *s != u'\n' && *s != u'\0' && *s != U_EOF)
+    {
+        if(__builtin_expect(*s == u'\r' || U16_IS_SURROGATE(*s), 0))
+            *needs_fixup = 1;
+        ++s;
+    }
+
+    return s;
+}
+
+static const UChar* skip_space_scalar(const UChar* s, const UChar* end)
+{
+    while(s < end && u_isspace(*s))
+        ++s;
+
+    return s;
+}
+
+static const UChar* find_key_end_scalar(const UChar* s, const UChar* end)
+{
+    while(s < end && *s != u'\"' && !u_isspace(*s))
+        ++s;
+
+    return s;
+}
+
+static const UChar* find_quote_scalar(const UChar* s, const UChar* end)
+{
+    while(s < end && *s != u'\"')
+        ++s;
+
+    return s;
+}
+
+#ifdef USCAN_X86
+
+// Below 0x80 u_isspace is exactly 0x09-0x0D and 0x1C-0x20, so a vector only
+// needs ICU for the lanes outside ASCII. Movemask gives two bits per lane.
+#define LANE(mask) (__builtin_ctz(mask) >> 1)
+#define CLEAR_LANE(mask) ((mask) & ~(3u << __builtin_ctz(mask)))
+
+static inline __m128i sse2_less_equal(const __m128i x, const uint16_t limit)
+{
+    return _mm_cmpeq_epi16(_mm_subs_epu16(x, _mm_set1_epi16(limit)), _mm_setzero_si128());
+}
+
+static inline __m128i sse2_ascii_space(const __m128i x)
+{
+    return _mm_or_si128(sse2_less_equal(_mm_sub_epi16(x, _mm_set1_epi16(0x09)), 0x0D - 0x09),
+                        sse2_less_equal(_mm_sub_epi16(x, _mm_set1_epi16(0x1C)), 0x20 - 0x1C));
+}
+
+static const UChar* find_line_end_sse2(const UChar* s, const UChar* end, uint8_t* needs_fixup)
+{
+    uint32_t fixup = 0;
+
+    while(end - s >= 8)
+    {
+        const __m128i x = _mm_loadu_si128((const __m128i*)s);
+        const __m128i term = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(x, _mm_set1_epi16(u'\n')),
+                                                        _mm_cmpeq_epi16(x, _mm_setzero_si128())),
+                                          _mm_cmpeq_epi16(x, _mm_set1_epi16(U_EOF)));
+        const __m128i fix = _mm_or_si128(_mm_cmpeq_epi16(x, _mm_set1_epi16(u'\r')),
+                                         sse2_less_equal(_mm_sub_epi16(x, _mm_set1_epi16(0xD800)), 0x7FF));
+
+        const uint32_t term_mask = _mm_movemask_epi8(term);
+        const uint32_t fix_mask = _mm_movemask_epi8(fix);
+        if(term_mask)
+        {
+            if(fixup | (fix_mask & ((term_mask & -term_mask) - 1)))
+                *needs_fixup = 1;
+            return s + LANE(term_mask);
+        }
+
+        fixup |= fix_mask;
+        s += 8;
+    }
+
+    if(fixup)
+        *needs_fixup = 1;
+
+    return find_line_end_scalar(s, end, needs_fixup);
+}
+
+static const UChar* skip_space_sse2(const UChar* s, const UChar* end)
+{
+    while(end - s >= 8)
+    {
+        const __m128i x = _mm_loadu_si128((const __m128i*)s);
+        uint32_t mask = ~_mm_movemask_epi8(sse2_ascii_space(x)) & 0xFFFF;
+
+        while(mask)
+        {
+            const UChar* p = s + LANE(mask);
+            if(*p < 0x80 || !u_isspace(*p))
+                return p;
+            mask = CLEAR_LANE(mask);
+        }
+
+        s += 8;
+    }
+
+    return skip_space_scalar(s, end);
+}
+
+static const UChar* find_key_end_sse2(const UChar* s, const UChar* end)
+{
+    while(end - s >= 8)
+    {
+        const __m128i x = _mm_loadu_si128((const __m128i*)s);
+        const __m128i non_ascii = _mm_xor_si128(sse2_less_equal(x, 0x7F), _mm_set1_epi16(-1));
+        const __m128i stop = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi16(x, _mm_set1_epi16(u'\"')), sse2_ascii_space(x)), non_ascii);
+        uint32_t mask = _mm_movemask_epi8(stop);
+
+        while(mask)
+        {
+            const UChar* p = s + LANE(mask);
+            if(*p < 0x80 || u_isspace(*p))
+                return p;
+            mask = CLEAR_LANE(mask);
+        }
+
+        s += 8;
+    }
+
+    return find_key_end_scalar(s, end);
+}
+
+static const UChar* find_quote_sse2(const UChar* s, const UChar* end)
+{
+    while(end - s >= 8)
+    {
+        const __m128i x = _mm_loadu_si128((const __m128i*)s);
+        const uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi16(x, _mm_set1_epi16(u'\"')));
+        if(mask)
+            return s + LANE(mask);
+
+        s += 8;
+    }
+
+    return find_quote_scalar(s, end);
+}
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline AVX2 __m256i avx2_less_equal(const __m256i x, const uint16_t limit)
+{
+    return _mm256_cmpeq_epi16(_mm256_subs_epu16(x, _mm256_set1_epi16(limit)), _mm256_setzero_si256());
+}
+
+static inline AVX2 __m256i avx2_ascii_space(const __m256i x)
+{
+    return _mm256_or_si256(avx2_less_equal(_mm256_sub_epi16(x, _mm256_set1_epi16(0x09)), 0x0D - 0x09),
+                           avx2_less_equal(_mm256_sub_epi16(x, _mm256_set1_epi16(0x1C)), 0x20 - 0x1C));
+}
+
+static AVX2 const UChar* find_line_end_avx2(const UChar* s, const UChar* end, uint8_t* needs_fixup)
+{
+    uint32_t fixup = 0;
+
+    while(end - s >= 16)
+    {
+        const __m256i x = _mm256_loadu_si256((const __m256i*)s);
+        const __m256i term = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(x, _mm256_set1_epi16(u'\n')),
+                                                              _mm256_cmpeq_epi16(x, _mm256_setzero_si256())),
+                                             _mm256_cmpeq_epi16(x, _mm256_set1_epi16(U_EOF)));
+        const __m256i fix = _mm256_or_si256(_mm256_cmpeq_epi16(x, _mm256_set1_epi16(u'\r')),
+                                            avx2_less_equal(_mm256_sub_epi16(x, _mm256_set1_epi16(0xD800)), 0x7FF));
+
+        const uint32_t term_mask = _mm256_movemask_epi8(term);
+        const uint32_t fix_mask = _mm256_movemask_epi8(fix);
+        if(term_mask)
+        {
+            if(fixup | (fix_mask & ((term_mask & -term_mask) - 1)))
+                *needs_fixup = 1;
+            return s + LANE(term_mask);
+        }
+
+        fixup |= fix_mask;
+        s += 16;
+    }
+
+    if(fixup)
+        *needs_fixup = 1;
+
+    return find_line_end_sse2(s, end, needs_fixup);
+}
+
+static AVX2 const UChar* skip_space_avx2(const UChar* s, const UChar* end)
+{
+    while(end - s >= 16)
+    {
+        const __m256i x = _mm256_loadu_si256((const __m256i*)s);
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(avx2_ascii_space(x));
+
+        while(mask)
+        {
+            const UChar* p = s + LANE(mask);
+            if(*p < 0x80 || !u_isspace(*p))
+                return p;
+            mask = CLEAR_LANE(mask);
+        }
+
+        s += 16;
+    }
+
+    return skip_space_sse2(s, end);
+}
+
+static AVX2 const UChar* find_key_end_avx2(const UChar* s, const UChar* end)
+{
+    while(end - s >= 16)
+    {
+        const __m256i x = _mm256_loadu_si256((const __m256i*)s);
+        const __m256i non_ascii = _mm256_xor_si256(avx2_less_equal(x, 0x7F), _mm256_set1_epi16(-1));
+        const __m256i stop = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi16(x, _mm256_set1_epi16(u'\"')), avx2_ascii_space(x)), non_ascii);
+        uint32_t mask = _mm256_movemask_epi8(stop);
+
+        while(mask)
+        {
+            const UChar* p = s + LANE(mask);
+            if(*p < 0x80 || u_isspace(*p))
+                return p;
+            mask = CLEAR_LANE(mask);
+        }
+
+        s += 16;
+    }
+
+    return find_key_end_sse2(s, end);
+}
+
+static AVX2 const UChar* find_quote_avx2(const UChar* s, const UChar* end)
+{
+    while(end - s >= 16)
+    {
+        const __m256i x = _mm256_loadu_si256((const __m256i*)s);
+        const uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi16(x, _mm256_set1_epi16(u'\"')));
+        if(mask)
+            return s + LANE(mask);
+
+        s += 16;
+    }
+
+    return find_quote_sse2(s, end);
+}
+
+static const UChar* (*find_line_end_impl)(const UChar*, const UChar*, uint8_t*) = find_line_end_sse2;
+static const UChar* (*skip_space_impl)(const UChar*, const UChar*) = skip_space_sse2;
+static const UChar* (*find_key_end_impl)(const UChar*, const UChar*) = find_key_end_sse2;
+static const UChar* (*find_quote_impl)(const UChar*, const UChar*) = find_quote_sse2;
+
+__attribute__((constructor)) static void ustring_scan_select(void)
+{
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        find_line_end_impl = find_line_end_avx2;
+        skip_space_impl = skip_space_avx2;
+        find_key_end_impl = find_key_end_avx2;
+        find_quote_impl = find_quote_avx2;
+    }
+}
+
+#else
+
+static const UChar* (*find_line_end_impl)(const UChar*, const UChar*, uint8_t*) = find_line_end_scalar;
+static const UChar* (*skip_space_impl)(const UChar*, const UChar*) = skip_space_scalar;
+static const UChar* (*find_key_end_impl)(const UChar*, const UChar*) = find_key_end_scalar;
+static const UChar* (*find_quote_impl)(const UChar*, const UChar*) = find_quote_scalar;
+
+#endif
+
+const UChar* ustring_find_line_end(const UChar* s, const UChar* end, uint8_t* needs_fixup)
+{
+    return find_line_end_impl(s, end, needs_fixup);
+}
+
+const UChar* ustring_skip_space(const UChar* s, const UChar* end)
+{
+    return skip_space_impl(s, end);
+}
+
+const UChar* ustring_find_key_end(const UChar* s, const UChar* end)
+{
+    return find_key_end_impl(s, end);
+}
+
+const UChar* ustring_find_quote(const UChar* s, const UChar* end)
+{
+    return find_quote_impl(s, end);
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#ifndef USTRING_SCAN_H_INCLUDED
+#define USTRING_SCAN_H_INCLUDED
+
+#include "ustring.h"
+
+// All scanners look at [s, end) and return end if nothing is found
+
+// First '\n', '\0' or U_EOF; needs_fixup is set if a '\r' or surrogate comes before it
+const UChar* ustring_find_line_end(const UChar* s, const UChar* end, uint8_t* needs_fixup);
+
+// First character for which u_isspace is false
+const UChar* ustring_skip_space(const UChar* s, const UChar* end);
+
+// First '"' or character for which u_isspace is true
+const UChar* ustring_find_key_end(const UChar* s, const UChar* end);
+
+// First '"'
+const UChar* ustring_find_quote(const UChar* s, const UChar* end);
+
+#endif
\ No newline at end of file
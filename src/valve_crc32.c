@@ -4,11 +4,10 @@
 //
 //=============================================================================//
 
+#include <stdint.h>
 #include "valve_crc32.h"
+#include "crc32_clmul.h"
 
-void CRC32_Init( CRC32_t *pulCRC );
-void CRC32_ProcessBuffer( CRC32_t *pulCRC, const void *p, int len );
-void CRC32_Final( CRC32_t *pulCRC );
 CRC32_t	CRC32_GetTableEntry( unsigned int slot );
 
 CRC32_t CRC32_ProcessSingleBuffer( const void *p, int len )
@@ -110,83 +109,71 @@ CRC32_t	CRC32_GetTableEntry( unsigned int slot )
 	return pulCRCTable[(unsigned char)slot];
 }
 
+// Slicing-by-8: pulCRCSliceTable[k][b] is the CRC of byte b followed by k zero bytes,
+// so eight input bytes fold into the CRC with eight independent lookups
+#define NUM_SLICES 8
+static CRC32_t pulCRCSliceTable[NUM_SLICES][NUM_BYTES];
+
+// Carry-less multiply folding for long buffers, picked once at load time from CPUID and never changed
+static int bCRCUseClmul = 0;
+
+__attribute__((constructor)) static void CRC32_InitSliceTables( void )
+{
+	bCRCUseClmul = crc32_clmul_available();
+
+	for ( unsigned int i = 0; i < NUM_BYTES; i++ )
+	{
+		CRC32_t ulCrc = pulCRCTable[i];
+		pulCRCSliceTable[0][i] = ulCrc;
+
+		for ( unsigned int k = 1; k < NUM_SLICES; k++ )
+		{
+			ulCrc = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
+			pulCRCSliceTable[k][i] = ulCrc;
+		}
+	}
+}
+
 void CRC32_ProcessBuffer(CRC32_t *pulCRC, const void *pBuffer, int nBuffer)
 {
 	CRC32_t ulCrc = *pulCRC;
-	unsigned char *pb = (unsigned char *)pBuffer;
-    unsigned int nFront;
-    int nMain;
-
-JustAfew:
-
-    switch (nBuffer)
-    {
-    case 7:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 6:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 5:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 4:
-        ulCrc ^= LittleLong( *(CRC32_t *)pb );
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-		*pulCRC = ulCrc;
-        return;
-
-    case 3:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 2:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 1:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-
-    case 0:
-		*pulCRC = ulCrc;
-        return;
-    }
-
-    // We may need to do some alignment work up front, and at the end, so that
-    // the main loop is aligned and only has to worry about 8 byte at a time.
-    //
-    // The low-order two bits of pb and nBuffer in total control the
-    // upfront work.
-    //
-    nFront = ((unsigned int)pb) & 3;
-    nBuffer -= nFront;
-    switch (nFront)
-    {
-    case 3:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-    case 2:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-    case 1:
-        ulCrc  = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
-    }
-
-    nMain = nBuffer >> 3;
-    while (nMain--)
-    {
-        ulCrc ^= LittleLong( *(CRC32_t *)pb );
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc ^= LittleLong( *(CRC32_t *)(pb + 4) );
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        ulCrc  = pulCRCTable[(unsigned char)ulCrc] ^ (ulCrc >> 8);
-        pb += 8;
-    }
-
-    nBuffer &= 7;
-    goto JustAfew;
-}
+	const unsigned char *pb = (const unsigned char *)pBuffer;
+
+	if (bCRCUseClmul && nBuffer >= CRC32_CLMUL_MIN_LENGTH)
+	{
+		const int nFold = nBuffer & ~15;
+		ulCrc = crc32_clmul_update(ulCrc, pb, nFold);
+		pb += nFold;
+		nBuffer -= nFold;
+	}
+
+	// Byte at a time until pb is 4 byte aligned
+	while (nBuffer > 0 && ((uintptr_t)pb & 3))
+	{
+		ulCrc = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
+		nBuffer--;
+	}
+
+	while (nBuffer >= 8)
+	{
+		const CRC32_t ulLow = LittleLong( *(const CRC32_t *)pb ) ^ ulCrc;
+		const CRC32_t ulHigh = LittleLong( *(const CRC32_t *)(pb + 4) );
+
+		ulCrc = pulCRCSliceTable[7][ulLow & 0xFF] ^
+			pulCRCSliceTable[6][(ulLow >> 8) & 0xFF] ^
+			pulCRCSliceTable[5][(ulLow >> 16) & 0xFF] ^
+			pulCRCSliceTable[4][ulLow >> 24] ^
+			pulCRCSliceTable[3][ulHigh & 0xFF] ^
+			pulCRCSliceTable[2][(ulHigh >> 8) & 0xFF] ^
+			pulCRCSliceTable[1][(ulHigh >> 16) & 0xFF] ^
+			pulCRCSliceTable[0][ulHigh >> 24];
+
+		pb += 8;
+		nBuffer -= 8;
+	}
+
+	while (nBuffer-- > 0)
+		ulCrc = pulCRCTable[*pb++ ^ (unsigned char)ulCrc] ^ (ulCrc >> 8);
+
+	*pulCRC = ulCrc;
+}
\ No newline at end of file
@@ -3,6 +3,10 @@
 
 typedef unsigned int CRC32_t;
 
+void CRC32_Init(CRC32_t* pulCRC);
+void CRC32_ProcessBuffer(CRC32_t* pulCRC, const void* p, int len);
+void CRC32_Final(CRC32_t* pulCRC);
+
 CRC32_t CRC32_ProcessSingleBuffer(const void* p, int len);
 
 #endif
\ No newline at end of file
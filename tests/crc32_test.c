@@ -0,0 +1,211 @@
+/*
+ * Checks CRC32_ProcessBuffer against a bitwise CRC-32 on random buffers of every length
+ * from 0 to TABLE_LENGTH, at every alignment and split into two calls at a random point.
+ * The slicing tables are checked alone by handing them pieces too short to be folded.
+ * When the CPU has it, carry-less multiply folding is checked directly and through
+ * CRC32_ProcessBuffer on random lengths up to MAX_LENGTH and around its 64 byte threshold.
+ * Then hashes caption keys the way the engine looks them up: lowercased, as UTF-8.
+ *
+ * Usage: crc32_test
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "valve_crc32.h"
+#include "crc32_clmul.h"
+#include "caption_reader.h"
+
+#define TABLE_LENGTH 4096
+#define MAX_LENGTH 8192
+#define MAX_OFFSET 16
+#define RANDOM_CHECKS 20000
+#define LONG_KEY_LENGTH 1000
+// Pieces below the length where CRC32_ProcessBuffer starts folding only go through the tables
+#define TABLE_PIECE (CRC32_CLMUL_MIN_LENGTH - 1)
+
+typedef struct _KnownKey {
+    const char* key;
+    uint32_t hash;
+} KnownKey;
+
+// Keys as written in caption sources, with the CRC-32 of their lowercased UTF-8 bytes
+// computed independently with zlib's crc32
+static const KnownKey known_keys[] = {
+    {"Alyx.HelloGordon", 0x7CB7FCED},
+    {"Barney.HeyGordon", 0xFCD56F88},
+    {"npc_citizen.question01", 0xC7C6EB35},
+    {"HL2_Chapter1_Title", 0x2DB7EC62},
+    {"vo/npc/Male01/hi01.wav", 0xDF131DD6},
+    {"#Valve_Hud_HEALTH", 0xA24A2423},
+    {"Énigme.Ärger", 0xB001CD46},
+    {"Голос.Привет", 0xCDA8E677},
+};
+
+// The reflected polynomial of CRC-32, one bit at a time so it shares nothing with the tables
+static uint32_t reference_crc32(const unsigned char* p, const size_t len)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for(size_t i = 0; i < len; ++i)
+    {
+        crc ^= p[i];
+        for(int bit = 0; bit < 8; ++bit)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+
+    return ~crc;
+}
+
+// xorshift64*, fixed seed so failures can be reproduced
+static uint64_t next_random(uint64_t* state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+// Hands the buffer over in pieces of at most piece bytes
+static void process_pieces(CRC32_t* crc, const unsigned char* p, int len, const int piece)
+{
+    while(len > 0)
+    {
+        const int size = (len < piece) ? len : piece;
+        CRC32_ProcessBuffer(crc, p, size);
+        p += size;
+        len -= size;
+    }
+}
+
+// Whole and split into two calls, each handed over in pieces of at most piece bytes
+static int8_t check_buffer(const unsigned char* p, const int len, const int split, const int piece, const char* backend)
+{
+    const uint32_t expected = reference_crc32(p, len);
+
+    CRC32_t whole;
+    CRC32_Init(&whole);
+    process_pieces(&whole, p, len, piece);
+    CRC32_Final(&whole);
+
+    CRC32_t parts;
+    CRC32_Init(&parts);
+    process_pieces(&parts, p, split, piece);
+    process_pieces(&parts, p + split, len - split, piece);
+    CRC32_Final(&parts);
+
+    if(__builtin_expect(whole != expected || parts != expected, 0))
+    {
+        fprintf(stderr, "%s: length %d at offset %d, split at %d: expected %08X, got %08X whole and %08X in parts\n",
+                backend, len, (int)((uintptr_t)p % MAX_OFFSET), split, expected, whole, parts);
+        return 0;
+    }
+
+    return 1;
+}
+
+// The folding alone, on the whole multiples of 16 bytes it takes
+static int8_t check_folding(const unsigned char* p, const int len)
+{
+    const uint32_t expected = reference_crc32(p, len);
+    const uint32_t folded = ~crc32_clmul_update(0xFFFFFFFF, p, len);
+    if(__builtin_expect(folded != expected, 0))
+    {
+        fprintf(stderr, "Folding: length %d at offset %d: expected %08X, got %08X\n", len, (int)((uintptr_t)p % MAX_OFFSET), expected, folded);
+        return 0;
+    }
+
+    return 1;
+}
+
+static int8_t check_key(const char* key, const uint32_t expected)
+{
+    uint32_t hash = 0;
+    if(!caption_reader_hash(key, &hash) || hash != expected)
+    {
+        fprintf(stderr, "Key '%.40s': expected %08X, got %08X\n", key, expected, hash);
+        return 0;
+    }
+
+    return 1;
+}
+
+int main(void)
+{
+    static unsigned char buffer[MAX_LENGTH + MAX_OFFSET] __attribute__((aligned(MAX_OFFSET)));
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    int failures = 0;
+
+    for(size_t i = 0; i < sizeof(buffer); ++i)
+        buffer[i] = next_random(&state) >> 56;
+
+    // The check value of CRC-32
+    if(CRC32_ProcessSingleBuffer("123456789", 9) != 0xCBF43926)
+    {
+        fprintf(stderr, "Wrong check value for \"123456789\"\n");
+        ++failures;
+    }
+
+    for(int len = 0; len <= TABLE_LENGTH; ++len)
+    {
+        const int offset = next_random(&state) % MAX_OFFSET;
+        const int split = len ? next_random(&state) % (len + 1) : 0;
+
+        failures += !check_buffer(buffer + offset, len, split, TABLE_PIECE, "Table");
+    }
+
+    // CRC32_ProcessBuffer folds whenever the CPU can
+    if(crc32_clmul_available())
+    {
+        // Just below, at and above the length where folding takes over, at every offset
+        static const int boundaries[] = {63, 64, 65, 79, 80, 81, 127, 128, 129};
+
+        for(size_t i = 0; i < sizeof(boundaries) / sizeof(boundaries[0]); ++i)
+        {
+            for(int offset = 0; offset < MAX_OFFSET; ++offset)
+            {
+                failures += !check_buffer(buffer + offset, boundaries[i], 0, MAX_LENGTH, "CLMUL");
+                failures += !check_buffer(buffer + offset, boundaries[i], boundaries[i], MAX_LENGTH, "CLMUL");
+                failures += !check_buffer(buffer + offset, boundaries[i], 1, MAX_LENGTH, "CLMUL");
+            }
+        }
+
+        for(int n = 0; n < RANDOM_CHECKS; ++n)
+        {
+            const int len = next_random(&state) % (MAX_LENGTH + 1);
+            const int offset = next_random(&state) % MAX_OFFSET;
+            const int split = next_random(&state) % (len + 1);
+
+            failures += !check_buffer(buffer + offset, len, split, MAX_LENGTH, "CLMUL");
+        }
+
+        for(int len = CRC32_CLMUL_MIN_LENGTH; len <= MAX_LENGTH; len += 16)
+            failures += !check_folding(buffer + len / 16 % MAX_OFFSET, len);
+    }
+    else
+        fprintf(stdout, "CRC32: no carry-less multiply on this CPU, only the tables were checked\n");
+
+    for(size_t i = 0; i < sizeof(known_keys) / sizeof(known_keys[0]); ++i)
+        failures += !check_key(known_keys[i].key, known_keys[i].hash);
+
+    // Longer than the buffer caption_hash lowercases and encodes into, so it's hashed in several pieces
+    char long_key[LONG_KEY_LENGTH + 1];
+    unsigned char lowered[LONG_KEY_LENGTH];
+    for(int i = 0; i < LONG_KEY_LENGTH; ++i)
+    {
+        long_key[i] = (i & 1) ? 'A' + i % 26 : 'a' + i % 26;
+        lowered[i] = 'a' + i % 26;
+    }
+    long_key[LONG_KEY_LENGTH] = '\0';
+    failures += !check_key(long_key, reference_crc32(lowered, LONG_KEY_LENGTH));
+
+    if(failures)
+    {
+        fprintf(stderr, "%d CRC32 checks failed\n", failures);
+        return 1;
+    }
+
+    fprintf(stdout, "CRC32: all checks passed\n");
+    return 0;
+}
\ No newline at end of file